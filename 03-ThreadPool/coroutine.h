@@ -0,0 +1,197 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace thread_pool {
+// CO-PROMISE
+template<typename T>
+class CoTask;
+
+template<typename T>
+struct CoPromiseBase
+{
+    std::coroutine_handle<> continuation;       // Coroutine awaiting the result
+    std::exception_ptr exception;               // Exception thrown by the coroutine
+
+    // The awaiting coroutine is resumed on the same thread, without going through the queue
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T>
+struct CoPromise : public CoPromiseBase<T>
+{
+    std::optional<T> value;
+
+    CoTask<T> get_return_object();
+    template<typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+    T result()
+    {
+        if (this->exception)
+            std::rethrow_exception(this->exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct CoPromise<void> : public CoPromiseBase<void>
+{
+    CoTask<void> get_return_object();
+    void return_void() const noexcept {}
+    void result()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+// CO-TASK
+// Lazy coroutine: it starts when awaited and resumes its awaiter when done
+template<typename T>
+class CoTask final
+{
+public:
+    using promise_type = CoPromise<T>;
+
+    CoTask() = default;
+    explicit CoTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    CoTask(CoTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    ~CoTask()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool valid() const noexcept { return (bool)handle; }
+
+    struct Awaiter
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+    };
+
+    Awaiter operator co_await() && noexcept { return Awaiter { handle }; }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename T>
+CoTask<T> CoPromise<T>::get_return_object() { return CoTask<T>(std::coroutine_handle<CoPromise<T>>::from_promise(*this)); }
+
+inline CoTask<void> CoPromise<void>::get_return_object() { return CoTask<void>(std::coroutine_handle<CoPromise<void>>::from_promise(*this)); }
+
+// SLEEP
+// Resume on an executor after the delay, the executor is free in the meantime
+template<typename Pool>
+struct SleepAwaitable
+{
+    Pool& pool;
+    std::chrono::steady_clock::duration delay;
+    Resumption resumption {};
+
+    bool await_ready() const noexcept { return delay <= std::chrono::steady_clock::duration::zero(); }
+    // A timer discarded by the destruction of the pool is rethrown as std::future_error(broken_promise)
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        try {
+            pool.schedule_after(delay, resumption.task(handle));
+        } catch (...) {
+            return resumption.fail(std::current_exception());
+        }
+        return resumption.suspend();
+    }
+    void await_resume() const { resumption.rethrow(); }
+};
+
+template<typename Pool>
+SleepAwaitable<Pool> sleep_for(Pool& pool, std::chrono::steady_clock::duration delay)
+{
+    return SleepAwaitable<Pool> { pool, delay };
+}
+
+// SPAWN
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+// Start the coroutine on an executor, its result is available through a Future.
+// A start refused by the pool, or a resumption dropped or cancelled, is stored in the Future.
+template<typename Pool, typename T>
+Future<T, Pool> spawn(Pool& pool, CoTask<T> task)
+{
+    auto state = std::make_shared<FutureState<T>>();
+    [](Pool& pool, CoTask<T> task, std::shared_ptr<FutureState<T>> state) -> Detached {
+        std::exception_ptr exception;
+        std::optional<std::conditional_t<std::is_void<T>::value, bool, T>> value;
+        try {
+            co_await pool.schedule();
+            if constexpr (std::is_void<T>::value) {
+                co_await std::move(task);
+                value.emplace(true);
+            } else {
+                value.emplace(co_await std::move(task));
+            }
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        state->fulfil(pool, [&]() -> T {
+            if (exception)
+                std::rethrow_exception(exception);
+            if constexpr (!std::is_void<T>::value)
+                return std::move(*value);
+        });
+    }(pool, std::move(task), state);
+    return Future<T, Pool>(pool, std::move(state));
+}
+// END
+} /* !namespace thread_pool */
@@ -1,8 +1,23 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <new>
+#include <stdexcept>
 #include <string>
 
 #include "thread_pool.h"
+#include "parallel.h"
+#include "numa.h"
+#include "coroutine.h"
+#include "task_group.h"
+#include "../T3-Bencher/bencher.h"
 
 // UTILS
 static int global_id = 0;
@@ -26,28 +41,653 @@ void showTime(const std::string& info, std::chrono::high_resolution_clock::time_
     std::cout << info << " executed in " << duration << "ms\n";
 }
 
+// ALLOCATIONS
+static std::atomic<size_t> allocations { 0 };
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    ++allocations;
+    size_t align = static_cast<size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+// Out of line: inlined after a known operator new, free() warns with -Wmismatched-new-delete
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete[](void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+// Former task layout: a std::function behind a std::unique_ptr
+template<typename F>
+thread_pool::Task boxed_task(F&& function)
+{
+    return [boxed = std::make_unique<std::function<void()>>(std::forward<F>(function))]() { (*boxed)(); };
+}
+// END
+
 // GENERATOR
 struct TaskGenerator
 {
     thread_pool::ThreadPool& thread_pool;
     int generator_count;
-    TaskGenerator(thread_pool::ThreadPool& pool, int generator_count)
-        : thread_pool(pool), generator_count(generator_count) {}
+    std::atomic<int>* executed;
+    bool boxed;
+    TaskGenerator(thread_pool::ThreadPool& pool, int generator_count, std::atomic<int>* executed = nullptr, bool boxed = false)
+        : thread_pool(pool), generator_count(generator_count), executed(executed), boxed(boxed) {}
 
     void execute()
     {
+        if (executed)
+            ++*executed;
         if (generator_count < 1)
             return;
         thread_pool::ThreadPool* tp = &thread_pool;
         int gc = generator_count - 1;
-        std::vector<thread_pool::UniqueTask> generator;
+        std::atomic<int>* ex = executed;
+        bool bx = boxed;
+        auto next = [=](){ TaskGenerator(*tp, gc, ex, bx).execute(); };
+        std::vector<thread_pool::Task> generator;
         generator.reserve(gc);
         for (int i = 0; i < gc; ++i)
-            generator.push_back(std::make_unique<thread_pool::Task>([=](){ TaskGenerator(*tp, gc).execute(); }));
+            generator.push_back(boxed ? boxed_task(next) : thread_pool::Task(next));
         thread_pool.schedule(std::move(generator));
     }
 };
 
+// FIBONACCI
+int fibonacci(thread_pool::ThreadPool& tp, int n)
+{
+    if (n < 15)
+        return n < 2 ? n : fibonacci(tp, n - 1) + fibonacci(tp, n - 2);
+    auto left = tp.submit(fibonacci, std::ref(tp), n - 1);
+    int right = fibonacci(tp, n - 2);
+    return left.get() + right;
+}
+// END
+
+// PIPELINE
+thread_pool::CoTask<int> read_request(thread_pool::ThreadPool& tp, int id)
+{
+    // Simulated I/O: the executor runs other coroutines in the meantime
+    co_await thread_pool::sleep_for(tp, std::chrono::milliseconds(2));
+    co_return id;
+}
+
+thread_pool::CoTask<int> handle_request(thread_pool::ThreadPool& tp, int id)
+{
+    int request = co_await read_request(tp, id);
+    co_return request * request;
+}
+// END
+
+int generated_tasks(int operation_count)
+{
+    int acc = 1;
+    int tot = 1;
+    for (int  i = operation_count - 1; i > 0; --i) {
+        acc *= i;
+        tot += acc;
+    }
+    return tot;
+}
+
+// BENCH-SCALING
+void bench_scaling()
+{
+    constexpr int operation_count = 9;
+    const int total = generated_tasks(operation_count);
+    bencher::Bencher<bencher::ExecutorState<10>> bench;
+    for (int threads : { 1, 2, 4, 8, 16, 32 }) {
+        for (bool stealing : { false, true }) {
+            thread_pool::Options options;
+            options.work_stealing = stealing;
+            thread_pool::ThreadPool tp(threads, options);
+            bench.bench(stealing ? "Work stealing" : "Global queue", std::to_string(threads), [&](auto& state) {
+                for (auto _ : state) {
+                    std::atomic<int> executed { 0 };
+                    tp.schedule(thread_pool::Task([&]() { TaskGenerator(tp, operation_count, &executed).execute(); }));
+                    while (executed != total) {
+                        if (!tp.execute())
+                            std::this_thread::yield();
+                    }
+                }
+            });
+        }
+    }
+    std::cout << "Generator of " << total << " tasks per run, by thread count\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-ALLOCATIONS
+void bench_allocations()
+{
+    constexpr int operation_count = 9;
+    const int total = generated_tasks(operation_count);
+    thread_pool::ThreadPool tp(4);
+    std::cout << "Generator of " << total << " tasks, " << sizeof(thread_pool::Task) << " bytes per task\n";
+    for (bool boxed : { true, false }) {
+        std::atomic<int> executed { 0 };
+        size_t before = allocations;
+        auto start = std::chrono::high_resolution_clock::now();
+        tp.schedule(thread_pool::Task([&]() { TaskGenerator(tp, operation_count, &executed, boxed).execute(); }));
+        while (executed != total) {
+            if (!tp.execute())
+                std::this_thread::yield();
+        }
+        auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << (boxed ? "  unique_ptr<function>: " : "  Task:                 ")
+                  << double(allocations - before) / total << " allocations per task, "
+                  << size_t(total / duration) << " tasks/s\n";
+    }
+}
+// END
+
+// BENCH-BATCH
+void bench_batch()
+{
+    thread_pool::ThreadPool tp(32);
+    bencher::Bencher<bencher::ExecutorState<10'000>> bench;
+    for (size_t batch_size : { 2, 8, 32 }) {
+        for (bool per_task : { true, false }) {
+            std::atomic<size_t> executed { 0 };
+            size_t expected = 0;
+            bench.bench(per_task ? "Push + notify per task" : "Batch + exact wake", std::to_string(batch_size), [&](auto& state) {
+                for (auto _ : state) {
+                    if (per_task) {
+                        // Former behaviour: each task is pushed then notified under its own lock acquisition
+                        for (size_t i = 0; i < batch_size; ++i) {
+                            std::array<thread_pool::Task, 1> task { thread_pool::Task([&]() { ++executed; }) };
+                            auto first = std::make_move_iterator(task.begin());
+                            std::lock_guard<std::mutex> lock { tp.mutex };
+                            ++tp.queued;
+                            tp.queue.push(first, std::make_move_iterator(task.end()), thread_pool::Priority::Normal, {});
+                            tp.waiter.notify_one();
+                        }
+                    } else {
+                        std::vector<thread_pool::Task> batch;
+                        for (size_t i = 0; i < batch_size; ++i)
+                            batch.push_back(thread_pool::Task([&]() { ++executed; }));
+                        tp.schedule(std::move(batch));
+                    }
+                    expected += batch_size;
+                    while (executed != expected)
+                        std::this_thread::yield();
+                }
+            });
+        }
+    }
+    std::cout << "Bursts of tasks on 32 threads, by batch size\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-QUEUE
+template<typename Queue>
+void bench_queue_policy(bencher::Bencher<bencher::ExecutorState<10>>& bench, const std::string& name)
+{
+    constexpr size_t task_count = 40'000;
+    thread_pool::BasicThreadPool<Queue> tp(4);
+    for (size_t producer_count : { 1, 4, 16 }) {
+        bench.bench(name, std::to_string(producer_count), [&](auto& state) {
+            for (auto _ : state) {
+                std::atomic<size_t> executed { 0 };
+                std::vector<std::thread> producers;
+                for (size_t p = 0; p < producer_count; ++p) {
+                    producers.emplace_back([&]() {
+                        for (size_t i = 0; i < task_count / producer_count; ++i)
+                            tp.schedule(thread_pool::Task([&]() { ++executed; }));
+                    });
+                }
+                for (auto& producer : producers)
+                    producer.join();
+                while (executed != task_count) {
+                    if (!tp.execute())
+                        std::this_thread::yield();
+                }
+            }
+        });
+    }
+}
+
+void bench_queue()
+{
+    bencher::Bencher<bencher::ExecutorState<10>> bench;
+    bench_queue_policy<thread_pool::LockedQueue>(bench, "deque + mutex");
+    bench_queue_policy<thread_pool::RingQueue<>>(bench, "MPMC ring");
+    std::cout << "40000 small tasks on 4 threads, by producer count\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-TIMERS
+void bench_timers()
+{
+    using clock = std::chrono::steady_clock;
+    constexpr size_t timer_count = 1'000;
+    constexpr auto delay = std::chrono::milliseconds(20);
+    thread_pool::ThreadPool tp(4);
+    std::cout << timer_count << " timers due in " << delay.count() << "ms\n";
+    for (bool pooled : { false, true }) {
+        std::atomic<size_t> fired { 0 };
+        std::atomic<int64_t> lateness { 0 };
+        std::vector<std::thread> sleepers;
+        auto start = clock::now();
+        auto due = start + delay;
+        auto task = [&]() {
+            lateness += std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - due).count();
+            ++fired;
+        };
+        for (size_t i = 0; i < timer_count; ++i) {
+            if (pooled) {
+                tp.schedule_at(due, thread_pool::Task(task));
+            } else {
+                // Former pattern: one sleeping thread per timer
+                sleepers.emplace_back([&]() {
+                    std::this_thread::sleep_until(due);
+                    tp.schedule(thread_pool::Task(task));
+                });
+            }
+        }
+        auto armed = clock::now();
+        while (fired != timer_count)
+            std::this_thread::yield();
+        for (auto& sleeper : sleepers)
+            sleeper.join();
+        std::cout << (pooled ? "  Timer heap:           " : "  One thread per timer: ")
+                  << std::chrono::duration_cast<std::chrono::microseconds>(armed - start).count() << "us to arm, "
+                  << lateness / int64_t(timer_count) << "us late on average\n";
+    }
+}
+// END
+
+// BENCH-LATENCY
+// Former idle loop: wait without predicate nor spin, a notification sent while no executor waits is lost
+struct FormerWaitPool
+{
+    std::mutex mutex;
+    std::condition_variable waiter;
+    std::condition_variable pool;
+    std::deque<thread_pool::Task> tasks;
+    bool stopping = false;
+    std::vector<std::thread> executors;
+
+    explicit FormerWaitPool(int count)
+    {
+        std::unique_lock<std::mutex> notif { mutex };
+        for (int index = 0; index < count; ++index) {
+            executors.emplace_back(&FormerWaitPool::execute_thread, this);
+            // Released by the executor waiting: the first task cannot be notified before it
+            pool.wait(notif);
+        }
+    }
+
+    ~FormerWaitPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            stopping = true;
+            waiter.notify_all();
+        }
+        for (auto& executor : executors)
+            executor.join();
+    }
+
+    void schedule(thread_pool::Task&& task)
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        tasks.push_back(std::move(task));
+        waiter.notify_one();
+    }
+
+    void execute_thread()
+    {
+        std::unique_lock<std::mutex> notif { mutex };
+        pool.notify_one();
+        while (!stopping) {
+            waiter.wait(notif);
+            while (!tasks.empty()) {
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                notif.unlock();
+                task();
+                notif.lock();
+            }
+        }
+    }
+};
+
+// One task every 20us, each one scheduled once the previous one started
+template<typename Pool>
+void measure_latency(Pool& tp, const std::string& name)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr size_t count = 20'000;
+    std::vector<clock::duration> latencies;
+    latencies.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::atomic<bool> started { false };
+        auto enqueued = clock::now();
+        tp.schedule(thread_pool::Task([&]() { latencies.push_back(clock::now() - enqueued); started = true; }));
+        while (!started)
+            std::this_thread::yield();
+        // Let the executors go idle before the next task
+        while (clock::now() - enqueued < std::chrono::microseconds(20))
+            ;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(latencies[size_t(p * (count - 1))]).count() / 1000.;
+    };
+    std::cout << "  " << name << ": p50 " << percentile(0.5) << "us, p90 " << percentile(0.9)
+              << "us, p99 " << percentile(0.99) << "us, p99.9 " << percentile(0.999) << "us";
+}
+
+void bench_latency()
+{
+    std::cout << "Enqueue to start latency, one task every 20us on 4 threads\n";
+    {
+        FormerWaitPool former(4);
+        measure_latency(former, "former wait");
+        std::cout << "\n";
+    }
+    for (auto spin : { std::chrono::microseconds(0), std::chrono::microseconds(50) }) {
+        thread_pool::Options options;
+        options.spin = spin;
+        thread_pool::ThreadPool tp(4, options);
+        measure_latency(tp, "spin " + std::to_string(spin.count()) + "us");
+        auto stats = tp.stats();
+        std::chrono::nanoseconds spinning {}, parked {};
+        for (const auto& worker : stats.workers) {
+            spinning += worker.spinning;
+            parked += worker.parked;
+        }
+        std::cout << " (spinning " << std::chrono::duration_cast<std::chrono::milliseconds>(spinning).count()
+                  << "ms, parked " << std::chrono::duration_cast<std::chrono::milliseconds>(parked).count() << "ms)\n";
+    }
+}
+// END
+
+// BENCH-PARALLEL
+void bench_parallel()
+{
+    thread_pool::ThreadPool tp(4);
+    bencher::Bencher<bencher::ExecutorState<10>> bench;
+    for (size_t size : { 10'000, 1'000'000 }) {
+        std::vector<double> values(size, 2.0);
+        auto col = std::to_string(size);
+        bench.bench("Plain loop", col, [&](auto& state) {
+            for (auto _ : state) {
+                for (size_t i = 0; i < size; ++i)
+                    values[i] = std::sqrt(values[i] + i);
+            }
+        });
+        bench.bench("One task per element", col, [&](auto& state) {
+            for (auto _ : state) {
+                std::atomic<size_t> done { 0 };
+                for (size_t i = 0; i < size; ++i)
+                    tp.schedule(thread_pool::Task([&, i]() { values[i] = std::sqrt(values[i] + i); ++done; }));
+                while (done != size) {
+                    if (!tp.execute())
+                        std::this_thread::yield();
+                }
+            }
+        });
+        bench.bench("parallel_for", col, [&](auto& state) {
+            for (auto _ : state) {
+                thread_pool::parallel_for(tp, size_t(0), size, size_t(1024), [&](size_t i) { values[i] = std::sqrt(values[i] + i); });
+            }
+        });
+        volatile double sum = 0;
+        bench.bench("Plain accumulate", col, [&](auto& state) {
+            for (auto _ : state) {
+                double acc = 0;
+                for (size_t i = 0; i < size; ++i)
+                    acc += values[i] * values[i];
+                sum = acc;
+            }
+        });
+        bench.bench("parallel_reduce", col, [&](auto& state) {
+            for (auto _ : state) {
+                sum = thread_pool::parallel_reduce(tp, size_t(0), size, size_t(1024), 0.0,
+                    [&](double acc, size_t i) { return acc + values[i] * values[i]; },
+                    [](double lhs, double rhs) { return lhs + rhs; });
+            }
+        });
+    }
+    std::cout << "Element-wise work on 4 threads, by element count\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-LIFETIME
+void bench_lifetime()
+{
+    using clock = std::chrono::steady_clock;
+    std::cout << "ThreadPool start and stop latency\n";
+    for (int threads : { 1, 4, 16, 64, 256 }) {
+        auto start = clock::now();
+        auto tp = std::make_unique<thread_pool::ThreadPool>(threads);
+        auto started = clock::now();
+        tp.reset();
+        auto stopped = clock::now();
+        std::cout << "  " << threads << " threads: start "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(started - start).count() << "us, stop "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(stopped - started).count() << "us\n";
+    }
+}
+// END
+
+// BLOCK-EXECUTOR
+// Occupies one executor until the returned function is called, the tasks scheduled meanwhile stay pending
+template<typename Pool>
+std::function<void()> block_executor(Pool& pool)
+{
+    auto opened = std::make_shared<std::atomic<bool>>(false);
+    std::atomic<bool> started { false };
+    pool.schedule(thread_pool::Task([&started, opened]() {
+        started = true;
+        while (!*opened)
+            std::this_thread::yield();
+    }));
+    while (!started)
+        std::this_thread::yield();
+    return [opened]() { *opened = true; };
+}
+// END
+
+// A dropped task breaks the promise of its future and fails its group
+void test_drop_oldest_promises()
+{
+    thread_pool::Options options;
+    options.capacity = 4;
+    options.overflow = thread_pool::Overflow::DropOldest;
+    thread_pool::ThreadPool bounded(1, options);
+    auto release = block_executor(bounded);
+    auto dropped = bounded.submit([]() { return 1; });
+    thread_pool::TaskGroup<> dropped_group(bounded);
+    dropped_group.run([]() {});
+    for (int i = 0; i < 10; ++i)
+        bounded.schedule(thread_pool::Task([]() {}));
+    release();
+    try {
+        dropped.get();
+    } catch (const std::future_error& e) {
+        std::cout << "Dropped future: " << e.what() << "\n";
+    }
+    try {
+        dropped_group.wait();
+    } catch (const std::future_error& e) {
+        std::cout << "Dropped group task: " << e.what() << "\n";
+    }
+}
+
+// With work stealing, a High task scheduled from outside goes before the local queue of the executor
+void test_local_priority()
+{
+    thread_pool::Options options;
+    options.work_stealing = true;
+    thread_pool::ThreadPool stealing(1, options);
+    std::string order;
+    std::atomic<bool> scheduled { false }, high { false };
+    std::atomic<size_t> executed { 0 };
+    stealing.schedule(thread_pool::Task([&]() {
+        std::vector<thread_pool::Task> local;
+        for (int i = 0; i < 3; ++i)
+            local.emplace_back([&]() { order.append("N"); ++executed; });
+        stealing.schedule(std::move(local));
+        scheduled = true;
+        while (!high)
+            std::this_thread::yield();
+    }));
+    while (!scheduled)
+        std::this_thread::yield();
+    stealing.schedule(thread_pool::Task([&]() { order.append("H"); ++executed; }), thread_pool::Priority::High);
+    high = true;
+    while (executed != 4)
+        std::this_thread::yield();
+    std::cout << "High task among local tasks: " << order << "\n";
+}
+
+// With work stealing, DropOldest also discards the tasks of the local queues
+void test_local_drop_oldest()
+{
+    thread_pool::Options options;
+    options.capacity = 4;
+    options.overflow = thread_pool::Overflow::DropOldest;
+    options.work_stealing = true;
+    thread_pool::Stats stats;
+    {
+        thread_pool::ThreadPool stealing(1, options);
+        std::atomic<bool> done { false };
+        stealing.schedule(thread_pool::Task([&]() {
+            for (int i = 0; i < 10; ++i) {
+                std::vector<thread_pool::Task> local;
+                local.emplace_back([]() {});
+                stealing.schedule(std::move(local));
+            }
+            done = true;
+        }));
+        while (!done)
+            std::this_thread::yield();
+        stats = stealing.stats();
+    }
+    std::cout << "Local DropOldest: " << stats.dropped << " dropped, high water mark " << stats.high_water_mark << "\n";
+}
+
+// A task run by the producer under CallerRuns is guarded like on an executor
+void test_caller_runs_exception()
+{
+    thread_pool::Options options;
+    options.capacity = 1;
+    options.overflow = thread_pool::Overflow::CallerRuns;
+    thread_pool::ThreadPool bounded(1, options);
+    auto release = block_executor(bounded);
+    bounded.schedule(thread_pool::Task([]() {}));
+    bounded.schedule(thread_pool::Task([]() { throw std::runtime_error("run by the caller"); }));
+    release();
+    std::cout << "CallerRuns: " << bounded.stats().exceptions << " exception counted, none thrown to the producer\n";
+}
+
+// A coroutine refused by a full pool stores the overflow in its future
+void test_refused_coroutine()
+{
+    thread_pool::Options options;
+    options.capacity = 1;
+    options.overflow = thread_pool::Overflow::Reject;
+    thread_pool::ThreadPool bounded(1, options);
+    auto release = block_executor(bounded);
+    bounded.schedule(thread_pool::Task([]() {}));
+    auto refused = thread_pool::spawn(bounded, handle_request(bounded, 1));
+    release();
+    try {
+        refused.get();
+    } catch (const thread_pool::OverflowException& e) {
+        std::cout << "Refused coroutine: " << e.what() << "\n";
+    }
+}
+
+// Shutdown::Cancel breaks the promises of the pending tasks and of their continuations
+void test_cancel_promises()
+{
+    thread_pool::Options options;
+    options.shutdown = thread_pool::Shutdown::Cancel;
+    auto cancelling = std::make_unique<thread_pool::ThreadPool>(1, options);
+    auto release = block_executor(*cancelling);
+    auto chained = cancelling->submit([]() { return 1; }).then([](int value) { return value + 1; });
+    thread_pool::TaskGroup<> cancelled_group(*cancelling);
+    cancelled_group.run([]() {});
+    auto spawned = thread_pool::spawn(*cancelling, handle_request(*cancelling, 1));
+    std::thread waiter([&]() {
+        try {
+            chained.get();
+        } catch (const std::future_error& e) {
+            std::cout << "Cancelled continuation: " << e.what() << "\n";
+        }
+        try {
+            spawned.get();
+        } catch (const std::future_error& e) {
+            std::cout << "Cancelled coroutine: " << e.what() << "\n";
+        }
+    });
+    // The pending tasks are cancelled while the executor is still blocked
+    std::thread opener([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); release(); });
+    cancelling.reset();
+    opener.join();
+    waiter.join();
+    try {
+        cancelled_group.wait();
+    } catch (const std::future_error& e) {
+        std::cout << "Cancelled group task: " << e.what() << "\n";
+    }
+}
+
+// A task adding a timer while the pool drains in its destructor
+void test_draining_timer()
+{
+    {
+        thread_pool::ThreadPool draining(1);
+        draining.schedule(thread_pool::Task([&draining]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            draining.schedule_after(std::chrono::milliseconds(1), thread_pool::Task([]() { display("Timer added while draining"); }));
+        }));
+    }
+    std::cout << "Timer added during the destruction discarded\n";
+}
+
+// Due timers skip the overflow policy: a full Reject pool still runs them, and counts their exceptions
+void test_full_pool_timers()
+{
+    using namespace std::chrono_literals;
+    thread_pool::Options options;
+    options.capacity = 1;
+    options.overflow = thread_pool::Overflow::Reject;
+    thread_pool::ThreadPool full(1, options);
+    auto release = block_executor(full);
+    std::atomic<bool> fired { false };
+    full.schedule(thread_pool::Task([]() {}));
+    full.schedule_after(1ms, thread_pool::Task([]() { throw std::runtime_error("timer failure"); }));
+    full.schedule_after(1ms, thread_pool::Task([&]() { fired = true; }));
+    std::this_thread::sleep_for(5ms);
+    release();
+    while (!fired)
+        std::this_thread::yield();
+    std::cout << "Timers due on a full pool: " << full.stats().exceptions << " exception counted\n";
+}
+
 // TESTS
 int main()
 {
@@ -59,29 +699,171 @@ int main()
         showTime("ThreadPool creation", now);
         // TEST-DISPLAY
         using namespace std::chrono_literals;
-        auto f1 = thread_pool::Task([]() { display("Display()"); std::this_thread::sleep_for(1ms); });
-        auto f2 = thread_pool::Task([]() { display("Display2()"); std::this_thread::sleep_for(1ms); });
-        std::vector<thread_pool::UniqueTask> displayTasks;
+        auto f1 = std::function<void()>([]() { display("Display()"); std::this_thread::sleep_for(1ms); });
+        auto f2 = std::function<void()>([]() { display("Display2()"); std::this_thread::sleep_for(1ms); });
+        std::vector<thread_pool::Task> displayTasks;
         for (auto& task : { f1, f1, f1, f2, f1, f2, f1, f1 })
-            displayTasks.push_back(std::make_unique<thread_pool::Task>(task));
+            displayTasks.push_back(thread_pool::Task(task));
         tp.schedule(std::move(displayTasks));
         std::this_thread::sleep_for(15ms);
         // TEST-GENERATOR
         constexpr int operation_count = 10;
         now = std::chrono::high_resolution_clock::now();
-        tp.schedule(std::make_unique<thread_pool::Task>([&]() { TaskGenerator(tp, operation_count).execute(); }));
+        tp.schedule(thread_pool::Task([&]() { TaskGenerator(tp, operation_count).execute(); }));
         while (tp.execute())
             ;
         // Compute the number of operations
-        int acc = 1;
-        int tot = 1;
-        for (int  i = operation_count - 1; i > 0; --i) {
-            acc *= i;
-            tot += acc;
-        }
+        int tot = generated_tasks(operation_count);
         showTime(std::to_string(tot) + " tasks", now);
+        // TEST-FUTURE
+        now = std::chrono::high_resolution_clock::now();
+        auto result = tp.submit(fibonacci, std::ref(tp), 30)
+            .then([](int value) { return std::to_string(value); })
+            .get();
+        showTime("fibonacci(30) = " + result, now);
+        // TEST-COROUTINE
+        now = std::chrono::high_resolution_clock::now();
+        std::vector<thread_pool::Future<int>> requests;
+        for (int id = 0; id < 100; ++id)
+            requests.push_back(thread_pool::spawn(tp, handle_request(tp, id)));
+        int responses = 0;
+        for (auto& request : requests)
+            responses += request.get();
+        showTime("100 coroutines waiting 2ms each, sum " + std::to_string(responses) + ",", now);
+        // TEST-TASK-GROUP
+        thread_pool::TaskGroup<> group(tp);
+        std::atomic<int> interrupted { 0 };
+        for (int i = 0; i < 4; ++i) {
+            group.run([&](const thread_pool::CancellationToken& token) {
+                while (!token.cancelled())
+                    std::this_thread::sleep_for(1ms);
+                ++interrupted;
+            });
+        }
+        group.run([]() { std::this_thread::sleep_for(5ms); throw std::runtime_error("task failure"); });
+        try {
+            group.wait();
+        } catch (const std::runtime_error& e) {
+            std::cout << "TaskGroup rethrew \"" << e.what() << "\", " << interrupted << " siblings cancelled\n";
+        }
+        thread_pool::ThreadPool survivor(1);
+        std::atomic<bool> survived { false };
+        survivor.schedule(thread_pool::Task([]() { throw std::runtime_error("lost"); }));
+        survivor.schedule(thread_pool::Task([&]() { survived = true; }));
+        while (!survived)
+            std::this_thread::yield();
+        std::cout << survivor.stats().exceptions << " exception thrown by a task, the executor still runs\n";
+        // TEST-PRIORITY
+        thread_pool::ThreadPool single(1);
+        auto release = block_executor(single);
+        single.schedule(thread_pool::Task([]() { display("Low priority"); }), thread_pool::Priority::Low);
+        single.schedule(thread_pool::Task([]() { display("Normal priority"); }), thread_pool::Priority::Normal);
+        single.schedule(thread_pool::Task([]() { display("High priority"); }), thread_pool::Priority::High);
+        auto depth = single.stats().queue_depth;
+        std::cout << "Queue depth: " << depth[0] << " high, " << depth[1] << " normal, " << depth[2] << " low\n";
+        release();
+        // TEST-OVERFLOW
+        const std::pair<thread_pool::Overflow, std::string> policies[] = {
+            { thread_pool::Overflow::Block, "Block" }, { thread_pool::Overflow::Reject, "Reject" },
+            { thread_pool::Overflow::CallerRuns, "CallerRuns" }, { thread_pool::Overflow::DropOldest, "DropOldest" } };
+        for (const auto& [overflow, name] : policies) {
+            thread_pool::Options options;
+            options.capacity = 4;
+            options.overflow = overflow;
+            std::atomic<int> executed { 0 };
+            thread_pool::Stats stats;
+            {
+                thread_pool::ThreadPool bounded(1, options);
+                auto release = block_executor(bounded);
+                std::thread opener([&]() { std::this_thread::sleep_for(5ms); release(); });
+                for (int i = 0; i < 10; ++i) {
+                    try {
+                        bounded.schedule(thread_pool::Task([&]() { ++executed; }));
+                    } catch (const thread_pool::OverflowException&) {}
+                }
+                opener.join();
+                stats = bounded.stats();
+            }
+            std::cout << name << ": " << executed << " executed, "
+                      << stats.rejected << " rejected, " << stats.caller_runs << " caller runs, "
+                      << stats.dropped << " dropped, high water mark " << stats.high_water_mark << "\n";
+        }
+        // TEST-NUMA
+        thread_pool::NumaThreadPool numa(2);
+        std::atomic<size_t> placed { 0 };
+        for (size_t node = 0; node < numa.node_count(); ++node) {
+            std::string cpus;
+            for (int cpu : numa.nodes[node])
+                cpus.append(" ").append(std::to_string(cpu));
+            std::cout << "NUMA node " << node << ", CPUs" << cpus << "\n";
+            numa.schedule(thread_pool::Task([&]() {
+                display("running on NUMA node " + std::to_string(numa.current_node()));
+                ++placed;
+            }), node);
+        }
+        while (placed != numa.node_count())
+            std::this_thread::yield();
+        // TEST-TIMER
+        std::atomic<int> ticks { 0 };
+        auto ticker = tp.schedule_every(5ms, thread_pool::Task([&]() { ++ticks; }));
+        tp.schedule_after(12ms, thread_pool::Task([&]() { display("Timer after 12ms, " + std::to_string(ticks) + " ticks"); }));
+        auto cancelled = tp.schedule_after(8ms, thread_pool::Task([]() { display("Cancelled timer"); }));
+        cancelled.cancel();
+        std::this_thread::sleep_for(30ms);
+        ticker.cancel();
+        std::cout << "Periodic timer: " << ticks << " ticks in 30ms\n";
+        // TEST-ELASTIC
+        thread_pool::Options elastic_options;
+        elastic_options.max_threads = 8;
+        elastic_options.grow_latency = 2ms;
+        elastic_options.keep_alive = 20ms;
+        thread_pool::ThreadPool elastic(1, elastic_options);
+        std::atomic<int> slow { 0 };
+        for (int i = 0; i < 64; ++i)
+            elastic.schedule(thread_pool::Task([&]() { std::this_thread::sleep_for(2ms); ++slow; }));
+        while (slow != 64)
+            std::this_thread::sleep_for(1ms);
+        auto resized = elastic.stats();
+        std::cout << "Elastic pool under load: " << resized.threads << " threads, " << resized.grown << " added\n";
+        std::this_thread::sleep_for(60ms);
+        resized = elastic.stats();
+        std::cout << "Elastic pool after keep-alive: " << resized.threads << " threads, " << resized.retired << " retired\n";
+        // TEST-METRICS
+        auto metrics = tp.stats();
+        if (metrics.run_time.count == 0) {
+            std::cout << "Metrics compiled out, build with -DTHREAD_POOL_METRICS=1\n";
+        } else {
+            auto us = [](std::chrono::nanoseconds duration) {
+                return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()) + "us";
+            };
+            for (size_t i = 0; i < metrics.workers.size(); ++i) {
+                const auto& worker = metrics.workers[i];
+                std::cout << "Executor " << i << ": " << worker.executed << " tasks, busy " << us(worker.busy)
+                          << ", idle " << us(worker.spinning + worker.parked) << ", " << worker.parks << " wake-ups\n";
+            }
+            std::cout << "Queue wait: p50 < " << us(metrics.queue_wait.percentile(0.5))
+                      << ", p99 < " << us(metrics.queue_wait.percentile(0.99)) << "\n"
+                      << "Run time: p50 < " << us(metrics.run_time.percentile(0.5))
+                      << ", p99 < " << us(metrics.run_time.percentile(0.99)) << "\n";
+        }
         // END
     }
+    test_drop_oldest_promises();
+    test_local_priority();
+    test_local_drop_oldest();
+    test_caller_runs_exception();
+    test_refused_coroutine();
+    test_cancel_promises();
+    test_draining_timer();
+    test_full_pool_timers();
     std::cout << "End ThreadPool\n";
+    bench_scaling();
+    bench_allocations();
+    bench_batch();
+    bench_queue();
+    bench_timers();
+    bench_latency();
+    bench_parallel();
+    bench_lifetime();
     return 0;
 }
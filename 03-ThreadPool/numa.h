@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace thread_pool {
+// TOPOLOGY
+// Parse a kernel CPU list such as "0-3,8-11"
+inline std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream stream { list };
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty())
+            continue;
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+inline std::string read_sysfs(const std::string& path)
+{
+    std::ifstream file { path };
+    std::string content;
+    std::getline(file, content);
+    return content;
+}
+
+// One CPU list per NUMA node, a single node with every CPU when the topology is unknown
+inline std::vector<std::vector<int>> numa_nodes()
+{
+    std::vector<std::vector<int>> nodes;
+    const std::string root = "/sys/devices/system/node/";
+    for (int node : parse_cpu_list(read_sysfs(root + "online"))) {
+        auto cpus = parse_cpu_list(read_sysfs(root + "node" + std::to_string(node) + "/cpulist"));
+        if (!cpus.empty())
+            nodes.push_back(std::move(cpus));
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            nodes.back().push_back(cpu);
+    }
+    return nodes;
+}
+
+// NUMA-POOL
+// One ThreadPool per NUMA node, its executors pinned to the CPUs of the node
+struct NumaThreadPool final
+{
+    std::vector<std::vector<int>> nodes;        // CPUs of each node
+    std::vector<std::unique_ptr<ThreadPool>> pools; // One pool per node
+    std::atomic<size_t> next_node { 0 };        // Round robin for tasks without hint
+
+    // threads_per_node: 0 for one executor per CPU of the node
+    NumaThreadPool(int threads_per_node = 0, Options options = Options()) : nodes(numa_nodes())
+    {
+        for (const auto& cpus : nodes) {
+            options.cpus = cpus;
+            pools.push_back(std::make_unique<ThreadPool>(threads_per_node > 0 ? threads_per_node : (int)cpus.size(), options));
+        }
+    }
+
+    size_t node_count() const { return pools.size(); }
+    ThreadPool& node(size_t index) { return *pools[index % pools.size()]; }
+
+    // Node of the calling executor, node_count() for any other thread
+    size_t current_node() const
+    {
+        for (size_t index = 0; index < pools.size(); ++index) {
+            if (pools[index]->is_worker())
+                return index;
+        }
+        return pools.size();
+    }
+
+    // The task runs on the given node: the memory it touches first is allocated there
+    void schedule(Task&& task, size_t node_hint) { node(node_hint).schedule(std::move(task)); }
+
+    // Without hint, an executor keeps the task on its own node
+    void schedule(Task&& task)
+    {
+        size_t current = current_node();
+        if (current == pools.size())
+            current = next_node++;
+        node(current).schedule(std::move(task));
+    }
+
+    bool execute()
+    {
+        size_t current = current_node();
+        if (current != pools.size())
+            return pools[current]->execute();
+        for (auto& pool : pools) {
+            if (pool->execute())
+                return true;
+        }
+        return false;
+    }
+};
+// END
+} /* !namespace thread_pool */
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace thread_pool {
+// SPLITTER
+template<typename Pool, typename Index, typename Leaf>
+struct RangeSplitter final
+{
+    Pool& pool;
+    Index grain;
+    Leaf& leaf;
+    std::atomic<size_t> pending { 0 };          // Chunks scheduled and not finished
+    std::mutex mutex;                           // Mutex for the first error
+    std::exception_ptr error;                   // First exception thrown by a chunk
+
+    RangeSplitter(Pool& pool, Index grain, Leaf& leaf) : pool(pool), grain(std::max<Index>(grain, 1)), leaf(leaf) {}
+
+    // Split in halves while some executors are idle, then run what remains
+    void run(Index first, Index last)
+    {
+        try {
+            while (last - first > grain && pool.idle_count() > 0) {
+                Index middle = first + (last - first) / 2;
+                ++pending;
+                // A dropped chunk is reported as std::future_error(broken_promise)
+                OnAbandon abandon([this]() { fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise))); --pending; });
+                pool.schedule(Task([this, middle, last, abandon = std::move(abandon)]() mutable {
+                    abandon.release();
+                    run(middle, last);
+                    --pending;
+                }));
+                last = middle;
+            }
+            leaf(first, last);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+
+    void fail(std::exception_ptr exception)
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        if (!error)
+            error = std::move(exception);
+    }
+
+    void operator()(Index first, Index last)
+    {
+        run(first, last);
+        // The caller takes part in the execution until every chunk is done
+        while (pending != 0) {
+            if (!pool.execute())
+                std::this_thread::yield();
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// PARALLEL-FOR
+template<typename Pool, typename Index, typename Body>
+void parallel_for(Pool& pool, Index begin, Index end, Index grain, Body&& body)
+{
+    if (!(begin < end))
+        return;
+    auto leaf = [&body](Index first, Index last) {
+        for (; first < last; ++first)
+            body(first);
+    };
+    RangeSplitter<Pool, Index, decltype(leaf)> { pool, grain, leaf }(begin, end);
+}
+
+// PARALLEL-REDUCE
+template<typename Pool, typename Index, typename T, typename Accumulate, typename Combine>
+T parallel_reduce(Pool& pool, Index begin, Index end, Index grain, T identity, Accumulate&& accumulate, Combine&& combine)
+{
+    if (!(begin < end))
+        return identity;
+    // Partial results are combined in range order, combine only needs to be associative
+    std::mutex mutex;
+    std::vector<std::pair<Index, T>> partials;
+    auto leaf = [&](Index first, Index last) {
+        T partial = identity;
+        for (Index i = first; i < last; ++i)
+            partial = accumulate(std::move(partial), i);
+        std::lock_guard<std::mutex> lock { mutex };
+        partials.emplace_back(first, std::move(partial));
+    };
+    RangeSplitter<Pool, Index, decltype(leaf)> { pool, grain, leaf }(begin, end);
+    std::sort(partials.begin(), partials.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    T result = std::move(identity);
+    for (auto& partial : partials)
+        result = combine(std::move(result), std::move(partial.second));
+    return result;
+}
+// END
+} /* !namespace thread_pool */
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace thread_pool {
+// TASK-GROUP
+// Tasks sharing a wait, the first exception and a cancellation token
+template<typename Pool = ThreadPool>
+class TaskGroup final
+{
+public:
+    explicit TaskGroup(Pool& pool) : pool(pool) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // The tasks reference the group, they must be done before its destruction
+    ~TaskGroup()
+    {
+        cancel();
+        try {
+            wait();
+        } catch (...) {}
+    }
+
+    // The function takes no argument, or the token to poll for cancellation.
+    // A task rejected or dropped by the pool fails the group with std::future_error(broken_promise).
+    template<typename F>
+    void run(F&& function)
+    {
+        ++pending;
+        OnAbandon abandon([this]() { fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise))); finish(); });
+        pool.schedule(Task([this, function = std::forward<F>(function), abandon = std::move(abandon)]() mutable {
+            abandon.release();
+            execute(function);
+        }));
+    }
+
+    // Tasks not started yet are skipped, running tasks see the token cancelled
+    void cancel() const { cancellation.cancel(); }
+    bool cancelled() const { return cancellation.cancelled(); }
+    const CancellationToken& token() const { return cancellation; }
+
+    // Help the pool until every task is done, then rethrow the first exception
+    void wait()
+    {
+        while (pending != 0) {
+            if (!pool.execute()) {
+                std::unique_lock<std::mutex> lock { mutex };
+                done.wait_for(lock, std::chrono::microseconds(100), [this]() { return pending == 0; });
+            }
+        }
+        // The last task releases the mutex after its decrement, the group can be destroyed afterwards
+        std::lock_guard<std::mutex> lock { mutex };
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+    }
+
+private:
+    template<typename F>
+    void execute(F& function)
+    {
+        if (!cancellation.cancelled()) {
+            try {
+                if constexpr (std::is_invocable<F&, const CancellationToken&>::value)
+                    function(cancellation);
+                else
+                    function();
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+        finish();
+    }
+
+    // A failure cancels the siblings
+    void fail(std::exception_ptr exception)
+    {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            if (!error)
+                error = std::move(exception);
+        }
+        cancel();
+    }
+
+    void finish()
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        if (--pending == 0)
+            done.notify_all();
+    }
+
+    Pool& pool;
+    CancellationToken cancellation;             // Shared by every task of the group
+    std::atomic<size_t> pending { 0 };          // Tasks scheduled and not finished
+    std::mutex mutex;                           // Mutex for the first error and the wait
+    std::condition_variable done;               // Notify the last task finished
+    std::exception_ptr error;                   // First exception thrown by a task
+};
+// END
+} /* !namespace thread_pool */
@@ -1,50 +1,744 @@
+#pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <exception>
 #include <functional>
+#include <future>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <optional>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <condition_variable>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifndef THREAD_POOL_TASK_SIZE
+#define THREAD_POOL_TASK_SIZE 48
+#endif
+
+// Per-task timestamps, counters and histograms (0: compiled out)
+#ifndef THREAD_POOL_METRICS
+#define THREAD_POOL_METRICS 0
+#endif
+
 namespace thread_pool {
-using Task = std::function<void()>;
-using UniqueTask = std::unique_ptr<Task>;
+// TASK
+template<size_t Capacity>
+class BasicTask final
+{
+    static_assert(Capacity >= sizeof(void*), "The inline storage must at least hold a pointer");
+
+    struct VTable
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* destination, void* source) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    // Captures small enough are stored inline, the others on the heap
+    template<typename F>
+    static constexpr bool is_inline = sizeof(F) <= Capacity
+        && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible<F>::value;
+
+    template<typename F>
+    static const VTable* inline_vtable()
+    {
+        static const VTable vtable {
+            [](void* storage) { (*static_cast<F*>(storage))(); },
+            [](void* destination, void* source) noexcept {
+                new (destination) F(std::move(*static_cast<F*>(source)));
+                static_cast<F*>(source)->~F();
+            },
+            [](void* storage) noexcept { static_cast<F*>(storage)->~F(); }
+        };
+        return &vtable;
+    }
+
+    template<typename F>
+    static const VTable* heap_vtable()
+    {
+        static const VTable vtable {
+            [](void* storage) { (**static_cast<F**>(storage))(); },
+            [](void* destination, void* source) noexcept {
+                *static_cast<F**>(destination) = *static_cast<F**>(source);
+            },
+            [](void* storage) noexcept { delete *static_cast<F**>(storage); }
+        };
+        return &vtable;
+    }
+
+public:
+    BasicTask() noexcept = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, BasicTask>::value>>
+    BasicTask(F&& function)
+    {
+        using Function = std::decay_t<F>;
+        if constexpr (is_inline<Function>) {
+            new (storage) Function(std::forward<F>(function));
+            vtable = inline_vtable<Function>();
+        } else {
+            *reinterpret_cast<Function**>(storage) = new Function(std::forward<F>(function));
+            vtable = heap_vtable<Function>();
+        }
+    }
+
+    BasicTask(BasicTask&& other) noexcept { steal(other); }
+    BasicTask& operator=(BasicTask&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            steal(other);
+        }
+        return *this;
+    }
+    BasicTask(const BasicTask&) = delete;
+    BasicTask& operator=(const BasicTask&) = delete;
+    ~BasicTask() { reset(); }
+
+    explicit operator bool() const noexcept { return vtable != nullptr; }
+    void operator()() { vtable->invoke(storage); }
+
+private:
+    void steal(BasicTask& other) noexcept
+    {
+        if (!other.vtable)
+            return;
+        other.vtable->move(storage, other.storage);
+        vtable = std::exchange(other.vtable, nullptr);
+    }
+
+    void reset() noexcept
+    {
+        if (vtable)
+            std::exchange(vtable, nullptr)->destroy(storage);
+    }
+
+    alignas(std::max_align_t) unsigned char storage[Capacity];
+    const VTable* vtable = nullptr;
+};
+// END
+
+using Task = BasicTask<THREAD_POOL_TASK_SIZE>;
+
+struct OverflowException : public std::exception
+{
+    const char* what() const noexcept override { return "thread_pool: task queue is full"; }
+};
+
+// ABANDON
+// Captured by the tasks someone waits for: a task destroyed without running (dropped by
+// Overflow::DropOldest, cancelled at shutdown) calls abandon so that the waiters are released.
+// Queued tasks are only destroyed outside the pool locks, abandon may schedule new tasks.
+template<typename F>
+class OnAbandon final
+{
+public:
+    explicit OnAbandon(F abandon) : abandon(std::move(abandon)) {}
+    OnAbandon(OnAbandon&& other) noexcept : abandon(std::move(other.abandon)), armed(std::exchange(other.armed, false)) {}
+    OnAbandon& operator=(OnAbandon&&) = delete;
+    ~OnAbandon()
+    {
+        if (armed)
+            abandon();
+    }
+
+    // Called first by the task when it runs
+    void release() noexcept { armed = false; }
+
+private:
+    F abandon;
+    bool armed = true;
+};
+
+// Hands a suspended coroutine over to a task. The task resumes it, or resumes it with
+// std::future_error(broken_promise) when the pool destroys the task without running it.
+// A task run or dropped before await_suspend returns lets the coroutine resume at once instead.
+class Resumption final
+{
+public:
+    template<typename Handle>
+    Task task(Handle handle)
+    {
+        OnAbandon abandon([this, handle]() { resume(handle, std::make_exception_ptr(std::future_error(std::future_errc::broken_promise))); });
+        return Task([this, handle, abandon = std::move(abandon)]() mutable {
+            abandon.release();
+            resume(handle, nullptr);
+        });
+    }
+
+    // Called by await_suspend once the task is handed over: false when the coroutine must not suspend
+    bool suspend()
+    {
+        int expected = Scheduling;
+        return state.compare_exchange_strong(expected, Suspended);
+    }
+
+    // The task could not be handed over, the coroutine rethrows the exception
+    bool fail(std::exception_ptr exception)
+    {
+        error = std::move(exception);
+        return false;
+    }
+
+    void rethrow() const
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    enum { Scheduling, Suspended, Done };
+
+    template<typename Handle>
+    void resume(Handle handle, std::exception_ptr exception)
+    {
+        error = std::move(exception);
+        if (state.exchange(Done) == Suspended)
+            handle.resume();
+    }
+
+    std::atomic<int> state { Scheduling };
+    std::exception_ptr error;
+};
+// END
+
+struct LockedQueue;
+template<typename Queue>
+struct BasicThreadPool;
+using ThreadPool = BasicThreadPool<LockedQueue>;
+
+template<typename T, typename Pool = ThreadPool>
+class Future;
+
+// PRIORITY
+enum class Priority : size_t { High, Normal, Low };
+constexpr size_t priority_count = 3;
+
+// OVERFLOW
+enum class Overflow
+{
+    Block,                                      // Wait for free space in the queue
+    Reject,                                     // Throw an OverflowException
+    CallerRuns,                                 // Execute the tasks on the scheduling thread
+    DropOldest                                  // Discard the oldest tasks of the lowest lanes
+};
+
+// SHUTDOWN
+enum class Shutdown
+{
+    Drain,                                      // Run every pending task before stopping
+    Cancel                                      // Discard the pending tasks, their promises are broken
+};
+
+// OPTIONS
+struct Options
+{
+    bool work_stealing = false;                 // One local queue per executor
+    std::chrono::microseconds spin { 50 };      // Longest spin before parking an idle executor
+    std::chrono::microseconds aging { 0 };      // Waiting time before a task is served first (0: disabled)
+    size_t capacity = 0;                        // Maximum pending tasks (0: unbounded)
+    Overflow overflow = Overflow::Block;        // Policy when the capacity is reached
+    std::vector<int> cpus;                      // CPU set the executors are pinned to (empty: no pinning)
+    Shutdown shutdown = Shutdown::Drain;        // Pending tasks at destruction
+    size_t max_threads = 0;                     // Elastic upper bound of executors, the count is the lower one (0: fixed)
+    std::chrono::microseconds grow_latency { 1000 }; // Queue latency adding an executor
+    std::chrono::milliseconds keep_alive { 1000 }; // Idle time retiring an executor above the count
+};
+
+// CANCELLATION
+// Shared flag, every copy cancels the same tasks
+struct CancellationToken
+{
+    CancellationToken() : state(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { *state = true; }
+    bool cancelled() const { return *state; }
+
+private:
+    std::shared_ptr<std::atomic<bool>> state;
+};
+
+// AFFINITY
+inline bool pin_current_thread(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+// END
+
+// HISTOGRAM
+struct Histogram
+{
+    static constexpr size_t bucket_count = 64;  // Bucket i counts durations in [2^i, 2^(i+1)) ns
+    std::array<size_t, bucket_count> buckets {};
+    size_t count = 0;
+
+    static size_t bucket(uint64_t nanoseconds)
+    {
+#if defined(__GNUC__)
+        return nanoseconds ? 63 - __builtin_clzll(nanoseconds) : 0;
+#else
+        size_t index = 0;
+        while (nanoseconds >>= 1)
+            ++index;
+        return index;
+#endif
+    }
+
+    // Upper bound of the bucket holding the quantile (0 < quantile <= 1)
+    std::chrono::nanoseconds percentile(double quantile) const
+    {
+        if (count == 0)
+            return {};
+        size_t rank = size_t(quantile * (count - 1)) + 1;
+        size_t seen = 0;
+        size_t index = 0;
+        for (; index < bucket_count - 1; ++index) {
+            seen += buckets[index];
+            if (seen >= rank)
+                break;
+        }
+        return std::chrono::nanoseconds((int64_t(1) << std::min<size_t>(index + 1, 62)) - 1);
+    }
+};
+
+// METRICS
+struct TaskMetrics
+{
+    std::atomic<size_t> executed { 0 };         // Tasks run
+    std::atomic<int64_t> busy { 0 };            // Nanoseconds spent running tasks
+    std::array<std::atomic<size_t>, Histogram::bucket_count> queue_wait {}; // Enqueue to start
+    std::array<std::atomic<size_t>, Histogram::bucket_count> run_time {};   // Start to end
+
+    void record(std::chrono::nanoseconds wait, std::chrono::nanoseconds run)
+    {
+        executed.fetch_add(1, std::memory_order_relaxed);
+        busy.fetch_add(run.count(), std::memory_order_relaxed);
+        queue_wait[Histogram::bucket(std::max<int64_t>(wait.count(), 0))].fetch_add(1, std::memory_order_relaxed);
+        run_time[Histogram::bucket(run.count())].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void collect(Histogram& wait, Histogram& run) const
+    {
+        for (size_t index = 0; index < Histogram::bucket_count; ++index) {
+            size_t waited = queue_wait[index].load(std::memory_order_relaxed);
+            size_t ran = run_time[index].load(std::memory_order_relaxed);
+            wait.buckets[index] += waited;
+            wait.count += waited;
+            run.buckets[index] += ran;
+            run.count += ran;
+        }
+    }
+};
+// END
+
+// STATS
+struct WorkerStats
+{
+    std::chrono::nanoseconds spinning {};       // Time spent spinning for jobs
+    std::chrono::nanoseconds parked {};         // Time spent parked on the condition
+    size_t parks = 0;                           // Number of times the executor parked (and was woken)
+    size_t executed = 0;                        // Tasks run (metrics only)
+    std::chrono::nanoseconds busy {};           // Time spent running tasks (metrics only)
+};
+
+struct Stats
+{
+    std::vector<WorkerStats> workers;
+    std::array<size_t, priority_count> queue_depth {}; // Tasks waiting in each priority lane
+    size_t local_depth = 0;                     // Tasks waiting in local queues
+    size_t high_water_mark = 0;                 // Highest number of pending tasks
+    size_t rejected = 0;                        // Tasks refused by Overflow::Reject
+    size_t caller_runs = 0;                     // Tasks run by Overflow::CallerRuns
+    size_t dropped = 0;                         // Tasks discarded by Overflow::DropOldest
+    Histogram queue_wait;                       // Enqueue to start durations (metrics only)
+    Histogram run_time;                         // Start to end durations (metrics only)
+    size_t threads = 0;                         // Running executors
+    size_t grown = 0;                           // Executors added for queue latency
+    size_t retired = 0;                         // Executors retired after the keep-alive
+    size_t exceptions = 0;                      // Exceptions thrown by tasks, use a Future or a TaskGroup to get them
+};
+
+// ENTRY
+struct TaskEntry
+{
+    Task task;
+    std::chrono::steady_clock::time_point enqueued; // Only stamped with aging or metrics enabled
+    explicit operator bool() const noexcept { return (bool)task; }
+};
+
+// LOCKED-QUEUE
+// Default queue policy: one std::deque per priority lane behind a std::mutex
+struct LockedQueue final
+{
+    explicit LockedQueue(const Options& options) : aging(options.aging) {}
+
+    // Push the tasks of [first, last), first is advanced past the pushed tasks
+    template<typename It>
+    void push(It& first, It last, Priority priority, std::chrono::steady_clock::time_point enqueued)
+    {
+        auto lane = static_cast<size_t>(priority);
+        std::lock_guard<std::mutex> lock { mutex };
+        for (; first != last; ++first) {
+            lanes[lane].push_back(TaskEntry { *first, enqueued });
+            ++depths[lane];
+        }
+    }
+
+    bool pop(TaskEntry& entry)
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        size_t lane = next_lane();
+        if (lane == priority_count)
+            return false;
+        entry = std::move(lanes[lane].front());
+        lanes[lane].pop_front();
+        --depths[lane];
+        return true;
+    }
+
+    // Move out the oldest tasks of the lowest lanes, the caller destroys them once unlocked
+    size_t drop(size_t count, std::vector<TaskEntry>& discarded)
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        size_t dropped = 0;
+        for (size_t lane = priority_count; lane > 0 && dropped < count; --lane) {
+            auto& entries = lanes[lane - 1];
+            for (; dropped < count && !entries.empty(); ++dropped) {
+                discarded.push_back(std::move(entries.front()));
+                entries.pop_front();
+                --depths[lane - 1];
+            }
+        }
+        return dropped;
+    }
+
+    size_t clear(std::vector<TaskEntry>& discarded)
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        size_t cleared = 0;
+        for (size_t lane = 0; lane < priority_count; ++lane) {
+            cleared += lanes[lane].size();
+            std::move(lanes[lane].begin(), lanes[lane].end(), std::back_inserter(discarded));
+            lanes[lane].clear();
+            depths[lane] = 0;
+        }
+        return cleared;
+    }
+
+    size_t depth(size_t lane) const { return depths[lane]; }
+
+private:
+    // Called with the mutex acquired
+    size_t next_lane() const
+    {
+        if (aging.count()) {
+            // A task waiting for too long in a lower lane is served first
+            auto now = std::chrono::steady_clock::now();
+            for (size_t lane = priority_count - 1; lane > 0; --lane) {
+                if (!lanes[lane].empty() && now - lanes[lane].front().enqueued > aging)
+                    return lane;
+            }
+        }
+        size_t lane = 0;
+        while (lane < priority_count && lanes[lane].empty())
+            ++lane;
+        return lane;
+    }
+
+    const std::chrono::microseconds aging;      // Waiting time before a task is served first
+    std::mutex mutex;                           // Mutex for the lanes
+    std::array<std::deque<TaskEntry>, priority_count> lanes; // One lane per priority
+    std::array<std::atomic<size_t>, priority_count> depths {}; // Tasks waiting in each lane
+};
+
+// RING-QUEUE
+constexpr size_t cache_line = 64;
+
+// Bounded lock-free multi-producer/multi-consumer queue policy, one ring per priority lane.
+// A slot can be written when its sequence equals the position, and read when it equals position + 1.
+template<size_t Capacity = 1024>
+struct RingQueue final
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+
+    explicit RingQueue(const Options&) {}
+
+    // Push the tasks of [first, last) until the ring is full, first is advanced past the pushed tasks
+    template<typename It>
+    void push(It& first, It last, Priority priority, std::chrono::steady_clock::time_point enqueued)
+    {
+        Ring& ring = rings[static_cast<size_t>(priority)];
+        for (; first != last; ++first) {
+            if (!ring.push(*first, enqueued))
+                return;
+        }
+    }
+
+    bool pop(TaskEntry& entry)
+    {
+        for (auto& ring : rings) {
+            if (ring.pop(entry))
+                return true;
+        }
+        return false;
+    }
+
+    // Move out the oldest tasks of the lowest lanes, the caller destroys them
+    size_t drop(size_t count, std::vector<TaskEntry>& discarded)
+    {
+        TaskEntry entry;
+        size_t dropped = 0;
+        for (size_t lane = priority_count; lane > 0 && dropped < count; --lane) {
+            for (; dropped < count && rings[lane - 1].pop(entry); ++dropped)
+                discarded.push_back(std::move(entry));
+        }
+        return dropped;
+    }
+
+    size_t clear(std::vector<TaskEntry>& discarded) { return drop(SIZE_MAX, discarded); }
+
+    size_t depth(size_t lane) const
+    {
+        size_t read = rings[lane].read.load(std::memory_order_relaxed);
+        size_t write = rings[lane].write.load(std::memory_order_relaxed);
+        return write > read ? write - read : 0;
+    }
+
+private:
+    // Padded so that neighbour slots are never written by two threads on the same cache line
+    struct alignas(cache_line) Slot
+    {
+        std::atomic<size_t> sequence;
+        TaskEntry entry;
+    };
+
+    struct Ring
+    {
+        alignas(cache_line) std::atomic<size_t> write { 0 }; // Next position to write
+        alignas(cache_line) std::atomic<size_t> read { 0 };  // Next position to read
+        std::unique_ptr<Slot[]> slots { new Slot[Capacity] };
+
+        Ring()
+        {
+            for (size_t position = 0; position < Capacity; ++position)
+                slots[position].sequence.store(position, std::memory_order_relaxed);
+        }
+
+        // The task is only moved from when a slot is acquired
+        bool push(Task&& task, std::chrono::steady_clock::time_point enqueued)
+        {
+            size_t position = write.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[position & (Capacity - 1)];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(sequence - position);
+                if (diff == 0) {
+                    if (write.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    return false;               // Full: the slot was not read since the last lap
+                } else {
+                    position = write.load(std::memory_order_relaxed);
+                }
+            }
+            slot->entry = TaskEntry { std::move(task), enqueued };
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(TaskEntry& entry)
+        {
+            size_t position = read.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[position & (Capacity - 1)];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+                if (diff == 0) {
+                    if (read.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    return false;               // Empty: the slot was not written yet
+                } else {
+                    position = read.load(std::memory_order_relaxed);
+                }
+            }
+            entry = std::move(slot->entry);
+            slot->sequence.store(position + Capacity, std::memory_order_release);
+            return true;
+        }
+    };
 
-struct StopException : public std::exception {};
+    std::array<Ring, priority_count> rings;
+};
+// END
 
-struct ThreadPool final
+template<typename Queue>
+struct BasicThreadPool final
 {
+    using clock = std::chrono::steady_clock;
+    using Entry = TaskEntry;
+#if THREAD_POOL_METRICS
+    using LocalEntry = Entry;                   // Local tasks are stamped for the queue wait histogram
+#else
+    using LocalEntry = Task;
+#endif
+
+    // WORKER
+    struct Worker
+    {
+        std::mutex mutex;                       // Mutex for the local queue
+        std::deque<LocalEntry> tasks;           // Local task collection (work-stealing only)
+        std::chrono::nanoseconds spin_budget;   // Current adaptive spin duration
+        std::atomic<int64_t> spinning { 0 };    // Nanoseconds spent spinning
+        std::atomic<int64_t> parked { 0 };      // Nanoseconds spent parked
+        std::atomic<size_t> parks { 0 };        // Number of parks
+        bool running = false;                   // An executor thread owns the slot (guarded by the mutex)
+#if THREAD_POOL_METRICS
+        TaskMetrics metrics;                    // Tasks run by this executor
+#endif
+    };
+
     // DATA
+    const Options options;                      // Pool configuration
     std::mutex mutex;                           // Mutex for incomming jobs
     std::condition_variable waiter;             // Notify incomming jobs
-    std::condition_variable pool;               // Notify thread creation
-    std::vector<std::thread> executors;         // Executor threads
-    std::deque<UniqueTask> tasks;               // Task collection
+    std::condition_variable pool;               // Notify executors start
+    std::condition_variable space;              // Notify free space for blocked producers
+    std::vector<std::thread> executors;         // Executor threads, one slot per worker
+    Queue queue;                                // Global task collection, one lane per priority
+    std::vector<std::unique_ptr<Worker>> workers; // Per executor data
+    std::atomic<size_t> queued { 0 };           // Tasks waiting in the global queue (counted before the push)
+    std::atomic<size_t> stealable { 0 };        // Tasks waiting in local queues
+    std::atomic<size_t> idle { 0 };             // Executors parked waiting for jobs
+    std::atomic<bool> stopping { false };       // Executors must stop once out of jobs
+    size_t started = 0;                         // Executors ready to accept jobs
+    size_t minimum = 0;                         // Executors never retired
+    std::atomic<size_t> alive { 0 };            // Running executors
+    std::atomic<size_t> grown { 0 };            // Resize counters
+    std::atomic<size_t> retired { 0 };
+    std::atomic<bool> probing { false };        // A latency probe is waiting in the queue
+    std::atomic<size_t> probes { 0 };           // Probes in the queue, not counted against the capacity
+    CancellationToken monitoring;               // Latency monitor, only armed while the pool can grow
+    std::atomic<size_t> exceptions { 0 };       // Exceptions thrown by tasks run on the pool
+    std::atomic<size_t> blocked { 0 };          // Producers waiting for free space
+    std::atomic<size_t> high_water { 0 };       // Highest number of pending tasks
+    std::atomic<size_t> rejected { 0 };         // Overflow counters
+    std::atomic<size_t> caller_runs { 0 };
+    std::atomic<size_t> dropped { 0 };
+#if THREAD_POOL_METRICS
+    TaskMetrics external;                       // Tasks run by other threads through execute()
+#endif
+
+    // TIMER-DATA
+    struct TimerState
+    {
+        Task task;
+        CancellationToken token;
+        std::atomic<bool> running { false };    // A periodic task never overlaps itself
+        bool direct = false;                    // Run on the timer thread itself (pool internals only)
+    };
+    struct Timer
+    {
+        clock::time_point due;
+        clock::duration period;                 // Zero for a one-shot timer
+        std::shared_ptr<TimerState> state;
+        bool operator<(const Timer& other) const { return due > other.due; } // Earliest on top of the heap
+    };
+    std::mutex timer_mutex;                     // Mutex for the timer heap
+    std::condition_variable timer_wake;         // Notify a new earliest timer or the destruction
+    std::vector<Timer> timers;                  // Pending timers, binary heap on the due time
+    std::thread timer;                          // Timer thread, started with the first timer
+    bool timer_stopping = false;                // No timer is added once set
+    // END
 
     // CTOR
-    ThreadPool(int count)
+    BasicThreadPool(int count) : BasicThreadPool(count, Options()) {}
+
+    BasicThreadPool(int count, const Options& options) : options(options), queue(options)
     {
-        std::unique_lock<std::mutex> notif { mutex };
-        for (; count > 0; --count) {
-            executors.push_back(std::thread(&ThreadPool::execute_thread, this));
-            pool.wait(notif);
+        // Elastic pools allocate every slot upfront, the vector is never resized while executors run
+        minimum = count;
+        size_t slots = std::max(minimum, options.max_threads);
+        for (size_t i = 0; i < slots; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+            workers.back()->spin_budget = options.spin;
+        }
+        // Start every executor, then wait for all of them at once
+        executors.resize(slots);
+        for (size_t index = 0; index < minimum; ++index) {
+            workers[index]->running = true;
+            executors[index] = std::thread(&BasicThreadPool::execute_thread, this, index);
         }
+        alive = minimum;
+        std::unique_lock<std::mutex> notif { mutex };
+        pool.wait(notif, [this]() { return started == minimum; });
+        // A fixed pool, or one created at its upper bound, starts no monitor and no timer thread
+        if (options.max_threads > minimum)
+            arm_monitor();
+        notif.unlock();
     }
 
     // DTOR
-    ~ThreadPool()
+    ~BasicThreadPool()
     {
-        std::vector<UniqueTask> tasks;
-        tasks.reserve(executors.size());
-        for (size_t i = 0; i < executors.size(); ++i)
-            tasks.push_back(std::make_unique<Task>([]() { throw StopException(); } ));
-        schedule(std::move(tasks));
+        // Pending timers are discarded, and so are the timers added by the tasks still draining
+        {
+            std::lock_guard<std::mutex> lock { timer_mutex };
+            timer_stopping = true;
+            timer_wake.notify_one();
+        }
+        if (timer.joinable())
+            timer.join();
+        // Destroyed while the executors still run: a discarded timer may resume a coroutine
+        std::vector<Timer> discarded;
+        {
+            std::lock_guard<std::mutex> lock { timer_mutex };
+            discarded.swap(timers);
+        }
+        discarded.clear();
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            stopping = true;
+            waiter.notify_all();
+        }
+        if (options.shutdown == Shutdown::Cancel)
+            cancel();
         for (auto& executor : executors) {
-            executor.join();
+            if (executor.joinable())
+                executor.join();
         }
-        while (auto f = get_task()) {
-            (*f)();
+        // Tasks scheduled by the last running tasks
+        if (options.shutdown == Shutdown::Cancel)
+            cancel();
+        while (auto entry = next_task(workers.size())) {
+            run_entry(entry, nullptr);
         }
     }
 
@@ -52,63 +746,833 @@ struct ThreadPool final
     template<typename C>
     void schedule(C&& coll)
     {
-        std::lock_guard<std::mutex> lock { mutex };
-        for (auto&& task : coll)
-            tasks.push_back(std::move(task));
-        waiter.notify_all();
+        if (Worker* worker = local_worker()) {
+            // Splice the whole batch and wake no more executors than tasks
+            auto first = std::make_move_iterator(std::begin(coll));
+            auto last = std::make_move_iterator(std::end(coll));
+            size_t count = std::distance(first, last);
+            if (count == 0)
+                return;
+            if (!admit_local(count)) {
+                run(first, last);
+                return;
+            }
+            auto enqueued = stamp();
+            {
+                std::lock_guard<std::mutex> lock { worker->mutex };
+                for (; first != last; ++first)
+                    worker->tasks.push_back(make_local(*first, enqueued));
+                stealable += count;
+            }
+            raise_high_water();
+            wake(count);
+            return;
+        }
+        schedule(std::forward<C>(coll), Priority::Normal);
     }
-    
-    void schedule(UniqueTask&& task)
+
+    template<typename C>
+    void schedule(C&& coll, Priority priority)
     {
-        std::lock_guard<std::mutex> lock { mutex };
-        tasks.push_back(std::move(task));
-        waiter.notify_one();
+        auto first = std::make_move_iterator(std::begin(coll));
+        auto last = std::make_move_iterator(std::end(coll));
+        size_t count = std::distance(first, last);
+        if (count == 0)
+            return;
+        // The queue policy has its own synchronization, the mutex only makes admission and push atomic
+        std::unique_lock<std::mutex> lock { mutex, std::defer_lock };
+        if (options.capacity != 0) {
+            lock.lock();
+            if (!admit(lock, count)) {
+                lock.unlock();
+                run(first, last);
+                return;
+            }
+        }
+        size_t pushed = enqueue(first, last, count, priority);
+        if (lock.owns_lock())
+            lock.unlock();
+        wake(pushed);
+        if (first != last)
+            overflow_queue(first, last, priority);
+    }
+
+    void schedule(Task&& task)
+    {
+        schedule(std::array<Task, 1> { std::move(task) });
+    }
+
+    void schedule(Task&& task, Priority priority)
+    {
+        schedule(std::array<Task, 1> { std::move(task) }, priority);
+    }
+
+    // AWAITABLE
+    // co_await pool.schedule() resumes the coroutine on an executor, see coroutine.h
+    struct Awaitable
+    {
+        BasicThreadPool& pool;
+        Priority priority;
+        Resumption resumption {};
+
+        bool await_ready() const noexcept { return false; }
+        // An overflow exception, or a task dropped or cancelled by the pool, is rethrown by the co_await
+        template<typename Handle>
+        bool await_suspend(Handle handle)
+        {
+            try {
+                pool.schedule(resumption.task(handle), priority);
+            } catch (...) {
+                return resumption.fail(std::current_exception());
+            }
+            return resumption.suspend();
+        }
+        void await_resume() const { resumption.rethrow(); }
+    };
+
+    Awaitable schedule(Priority priority = Priority::Normal) { return Awaitable { *this, priority }; }
+    // END
+
+    // SUBMIT
+    template<typename F, typename... Args>
+    auto submit(F&& function, Args&&... args) -> Future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>, BasicThreadPool>;
+
+    // TIMERS
+    // Run the task on the pool at the given time, unless the token is cancelled
+    CancellationToken schedule_at(clock::time_point time, Task&& task, CancellationToken token = CancellationToken())
+    {
+        add_timer(time, clock::duration::zero(), std::move(task), token);
+        return token;
     }
 
+    CancellationToken schedule_after(clock::duration delay, Task&& task, CancellationToken token = CancellationToken())
+    {
+        return schedule_at(clock::now() + delay, std::move(task), std::move(token));
+    }
+
+    // Run the task every period, the first time after one period, until the token is cancelled
+    CancellationToken schedule_every(clock::duration period, Task&& task, CancellationToken token = CancellationToken())
+    {
+        add_timer(clock::now() + period, std::max<clock::duration>(period, std::chrono::microseconds(1)), std::move(task), token);
+        return token;
+    }
+    // END
+
+    bool is_worker() const { return context().owner == this; }
+    size_t idle_count() const { return idle; }
+
     // EXECUTE
     bool execute()
     {
-        try {
-            std::unique_lock<std::mutex> lock { mutex };
-            if (auto t = get_task()) {
+        size_t index = local_index();
+        if (auto entry = next_task(index)) {
+            run_entry(entry, index < workers.size() ? workers[index].get() : nullptr);
+            return true;
+        }
+        return false;
+    }
+
+    // STATS-SNAPSHOT
+    Stats stats() const
+    {
+        Stats result;
+        for (const auto& worker : workers) {
+            WorkerStats& stats = *result.workers.emplace(result.workers.end());
+            stats.spinning = std::chrono::nanoseconds(worker->spinning.load(std::memory_order_relaxed));
+            stats.parked = std::chrono::nanoseconds(worker->parked.load(std::memory_order_relaxed));
+            stats.parks = worker->parks.load(std::memory_order_relaxed);
+#if THREAD_POOL_METRICS
+            stats.executed = worker->metrics.executed.load(std::memory_order_relaxed);
+            stats.busy = std::chrono::nanoseconds(worker->metrics.busy.load(std::memory_order_relaxed));
+            worker->metrics.collect(result.queue_wait, result.run_time);
+#endif
+        }
+#if THREAD_POOL_METRICS
+        external.collect(result.queue_wait, result.run_time);
+#endif
+        for (size_t lane = 0; lane < priority_count; ++lane)
+            result.queue_depth[lane] = queue.depth(lane);
+        result.local_depth = stealable;
+        result.high_water_mark = high_water;
+        result.rejected = rejected;
+        result.caller_runs = caller_runs;
+        result.dropped = dropped;
+        result.threads = alive;
+        result.grown = grown;
+        result.retired = retired;
+        result.exceptions = exceptions;
+        return result;
+    }
+    // END
+
+private:
+    struct Context
+    {
+        BasicThreadPool* owner = nullptr;
+        size_t index = 0;
+    };
+
+    static Context& context()
+    {
+        thread_local Context current;
+        return current;
+    }
+
+    Worker* local_worker() const
+    {
+        const Context& current = context();
+        return options.work_stealing && current.owner == this ? workers[current.index].get() : nullptr;
+    }
+
+    size_t local_index() const
+    {
+        const Context& current = context();
+        return current.owner == this ? current.index : workers.size();
+    }
+
+    bool has_task() const { return queued != 0 || stealable != 0; }
+    size_t pending() const { return queued + stealable; }
+
+    // Pending tasks counted against the capacity
+    size_t backlog() const
+    {
+        size_t current = pending();
+        return current - std::min<size_t>(probes, current);
+    }
+
+    // ADMIT
+    // Called with the mutex acquired, false when the tasks must run on the caller thread
+    bool admit(std::unique_lock<std::mutex>& lock, size_t count)
+    {
+        if (options.capacity == 0 || backlog() + count <= options.capacity)
+            return true;
+        switch (options.overflow) {
+        case Overflow::Reject:
+            rejected += count;
+            throw OverflowException();
+        case Overflow::DropOldest: {
+            // Abandoned tasks may schedule continuations: they are destroyed unlocked
+            std::vector<Entry> discarded;
+            drop(backlog() + count - options.capacity, discarded);
+            if (!discarded.empty()) {
                 lock.unlock();
-                (*t)();
+                discarded.clear();
+                lock.lock();
+            }
+            return true;
+        }
+        case Overflow::Block:
+            // An executor waiting for free space could stall the whole pool
+            if (!is_worker()) {
+                ++blocked;
+                space.wait(lock, [&]() { return backlog() + count <= options.capacity || backlog() == 0; });
+                --blocked;
                 return true;
             }
-        } catch (const StopException&) {
-            schedule(std::make_unique<Task>([]() { throw StopException(); } ));
+            [[fallthrough]];
+        case Overflow::CallerRuns:
+            caller_runs += count;
+            return false;
         }
-        return false;
+        return true;
+    }
+
+    bool admit_local(size_t count)
+    {
+        if (options.capacity == 0 || backlog() + count <= options.capacity)
+            return true;
+        std::unique_lock<std::mutex> lock { mutex };
+        return admit(lock, count);
+    }
+
+    // The oldest tasks of the lowest lanes are discarded, they break the promise of their waiters.
+    // With work stealing, the local queues are then dropped from their front, the end thieves take.
+    void drop(size_t count, std::vector<Entry>& discarded)
+    {
+        size_t removed = queue.drop(count, discarded);
+        queued -= removed;
+        dropped += removed;
+        for (auto& worker : workers) {
+            if (removed == count)
+                break;
+            std::lock_guard<std::mutex> worker_lock { worker->mutex };
+            size_t local = std::min(count - removed, worker->tasks.size());
+            for (size_t index = 0; index < local; ++index)
+                discarded.push_back(make_entry(std::move(worker->tasks[index])));
+            worker->tasks.erase(worker->tasks.begin(), worker->tasks.begin() + local);
+            stealable -= local;
+            dropped += local;
+            removed += local;
+        }
+    }
+
+    // A bounded queue policy is full, the overflow policy applies to the tasks left
+    template<typename It>
+    void overflow_queue(It& first, It last, Priority priority)
+    {
+        while (first != last) {
+            size_t left = std::distance(first, last);
+            switch (options.overflow) {
+            case Overflow::Reject:
+                rejected += left;
+                throw OverflowException();
+            case Overflow::DropOldest: {
+                std::vector<Entry> discarded;
+                drop(left, discarded);
+                break;
+            }
+            case Overflow::Block:
+                if (!is_worker()) {
+                    std::this_thread::yield();
+                    break;
+                }
+                [[fallthrough]];
+            case Overflow::CallerRuns:
+                caller_runs += left;
+                run(first, last);
+                return;
+            }
+            wake(enqueue(first, last, left, priority));
+        }
+    }
+
+    // Tasks run by the caller are counted and guarded like those of the executors
+    template<typename It>
+    void run(It first, It last)
+    {
+        size_t index = local_index();
+        Worker* worker = index < workers.size() ? workers[index].get() : nullptr;
+        for (; first != last; ++first) {
+            Entry entry { Task { *first }, stamp() };
+            run_entry(entry, worker);
+        }
+    }
+
+    // Timer tasks skip the admission: no overflow policy may throw, block or run a task on the timer thread.
+    // The capacity bounds the producers, the due timers can exceed it.
+    void dispatch(Task&& task)
+    {
+        std::array<Task, 1> tasks { std::move(task) };
+        auto first = std::make_move_iterator(tasks.begin());
+        auto last = std::make_move_iterator(tasks.end());
+        // Only a full ring refuses the task, an executor frees a slot soon
+        while (enqueue(first, last, 1, Priority::Normal) == 0)
+            std::this_thread::yield();
+        wake(1);
+    }
+
+    // Push as many tasks as the queue policy accepts, first is advanced past them
+    template<typename It>
+    size_t enqueue(It& first, It last, size_t count, Priority priority)
+    {
+        // Counted first: an executor popping a task still being pushed never sees queued underflow
+        queued += count;
+        queue.push(first, last, priority, stamp());
+        size_t left = std::distance(first, last);
+        if (left != 0)
+            queued -= left;
+        raise_high_water();
+        return count - left;
+    }
+
+    void raise_high_water()
+    {
+        size_t current = pending();
+        size_t mark = high_water.load(std::memory_order_relaxed);
+        while (current > mark && !high_water.compare_exchange_weak(mark, current, std::memory_order_relaxed))
+            ;
+    }
+
+    // The pending tasks break the promise of their waiters. They are destroyed unlocked, and the
+    // continuations their waiters schedule meanwhile are cancelled by the next round.
+    void cancel()
+    {
+        std::vector<Entry> discarded;
+        do {
+            discarded.clear();
+            std::lock_guard<std::mutex> lock { mutex };
+            queued -= queue.clear(discarded);
+            for (auto& worker : workers) {
+                std::lock_guard<std::mutex> worker_lock { worker->mutex };
+                stealable -= worker->tasks.size();
+                for (auto& task : worker->tasks)
+                    discarded.push_back(make_entry(std::move(task)));
+                worker->tasks.clear();
+            }
+        } while (!discarded.empty());
+    }
+
+    void release_space()
+    {
+        if (blocked == 0)
+            return;
+        std::lock_guard<std::mutex> lock { mutex };
+        space.notify_all();
     }
     // END
 
-private:
-    UniqueTask get_task()
+    clock::time_point stamp() const
+    {
+        return THREAD_POOL_METRICS || options.aging.count() ? clock::now() : clock::time_point();
+    }
+
+    static LocalEntry make_local(Task&& task, clock::time_point enqueued)
+    {
+#if THREAD_POOL_METRICS
+        return Entry { std::move(task), enqueued };
+#else
+        (void)enqueued;
+        return std::move(task);
+#endif
+    }
+
+    static Entry make_entry(Entry&& entry) { return std::move(entry); }
+    static Entry make_entry(Task&& task) { return Entry { std::move(task), clock::time_point() }; }
+
+    // RUN-ENTRY
+    // The exception of a task never escapes to the thread running it: executors keep running
+    void run_entry(Entry& entry, Worker* worker)
+    {
+        try {
+#if THREAD_POOL_METRICS
+            auto start = clock::now();
+            entry.task();
+            auto end = clock::now();
+            (worker ? worker->metrics : external).record(start - entry.enqueued, end - start);
+#else
+            (void)worker;
+            entry.task();
+#endif
+        } catch (...) {
+            ++exceptions;
+        }
+    }
+    // END
+
+    Entry get_task()
     {
-        if (tasks.empty())
-            return UniqueTask();
-        UniqueTask item { std::move(tasks.front()) };
-        tasks.pop_front();
+        Entry item;
+        if (!queue.pop(item))
+            return Entry();
+        --queued;
+        release_space();
         return item;
     }
 
-    // EXECUTE-THREAD
-    void execute_thread()
+    // STEAL
+    Entry pop_task(Worker& worker, bool owner)
+    {
+        Entry item;
+        {
+            std::lock_guard<std::mutex> lock { worker.mutex };
+            if (worker.tasks.empty())
+                return Entry();
+            if (owner) {
+                // The owner works on the most recent task, its data is still hot
+                item = make_entry(std::move(worker.tasks.back()));
+                worker.tasks.pop_back();
+            } else {
+                // Thieves take the oldest task, the farthest from the owner
+                item = make_entry(std::move(worker.tasks.front()));
+                worker.tasks.pop_front();
+            }
+            --stealable;
+        }
+        release_space();
+        return item;
+    }
+
+    Entry next_task(size_t index)
+    {
+        if (options.work_stealing && index < workers.size()) {
+            // The local queues only hold Normal tasks, a pending High task goes first
+            if (queue.depth(static_cast<size_t>(Priority::High)) != 0) {
+                if (auto t = get_task())
+                    return t;
+            }
+            if (auto t = pop_task(*workers[index], true))
+                return t;
+        }
+        if (queued != 0) {
+            if (auto t = get_task())
+                return t;
+        }
+        if (stealable == 0)
+            return Entry();
+        size_t start = index < workers.size() ? index + 1 : 0;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (auto t = pop_task(*workers[(start + i) % workers.size()], false))
+                return t;
+        }
+        return Entry();
+    }
+
+    // Called with the mutex acquired
+    void notify(size_t count)
+    {
+        for (count = std::min(count, idle.load()); count > 0; --count)
+            waiter.notify_one();
+    }
+
+    void wake(size_t count)
+    {
+        if (idle == 0)
+            return;
+        std::lock_guard<std::mutex> lock { mutex };
+        notify(count);
+    }
+    // END
+
+    // TIMER-THREAD
+    void add_timer(clock::time_point due, clock::duration period, Task&& task, const CancellationToken& token, bool direct = false)
+    {
+        auto state = std::make_shared<TimerState>();
+        state->task = std::move(task);
+        state->token = token;
+        state->direct = direct;
+        const TimerState* added = state.get();
+        std::lock_guard<std::mutex> lock { timer_mutex };
+        // A task draining in the destructor must not start a timer thread nobody joins
+        if (timer_stopping)
+            return;
+        if (!timer.joinable())
+            timer = std::thread(&BasicThreadPool::timer_thread, this);
+        timers.push_back(Timer { due, period, std::move(state) });
+        std::push_heap(timers.begin(), timers.end());
+        // Only a new earliest timer shortens the wait of the timer thread
+        if (timers.front().state.get() == added)
+            timer_wake.notify_one();
+    }
+
+    void timer_thread()
+    {
+        std::unique_lock<std::mutex> lock { timer_mutex };
+        while (!timer_stopping) {
+            if (timers.empty()) {
+                timer_wake.wait(lock);
+                continue;
+            }
+            auto now = clock::now();
+            if (now < timers.front().due) {
+                timer_wake.wait_until(lock, timers.front().due);
+                continue;
+            }
+            std::pop_heap(timers.begin(), timers.end());
+            Timer due = std::move(timers.back());
+            timers.pop_back();
+            // Cancelled timers are only removed from the heap when due, and destroyed unlocked
+            if (due.state->token.cancelled()) {
+                lock.unlock();
+                due.state.reset();
+                lock.lock();
+                continue;
+            }
+            if (due.period != clock::duration::zero()) {
+                // Occurrences missed while the timer thread was late are skipped
+                Timer next { due.due + due.period, due.period, due.state };
+                while (next.due <= now)
+                    next.due += next.period;
+                timers.push_back(std::move(next));
+                std::push_heap(timers.begin(), timers.end());
+            }
+            lock.unlock();
+            if (due.state->direct) {
+                try {
+                    due.state->task();
+                } catch (...) {
+                    ++exceptions;
+                }
+                lock.lock();
+                continue;
+            }
+            dispatch(Task([state = std::move(due.state)]() {
+                if (state->token.cancelled() || state->running.exchange(true))
+                    return;
+                try {
+                    state->task();
+                } catch (...) {
+                    state->running = false;
+                    throw;
+                }
+                state->running = false;
+            }));
+            lock.lock();
+        }
+    }
+    // END
+
+    // ELASTIC
+    // Called with the mutex acquired
+    void arm_monitor()
+    {
+        monitoring = CancellationToken();
+        add_timer(clock::now() + options.grow_latency, options.grow_latency, Task([this]() { monitor(); }), monitoring, true);
+    }
+
+    // Called by the timer thread every grow_latency
+    void monitor()
+    {
+        // Idle executors take new tasks at once, the queue latency only grows when all are busy
+        if (idle != 0 || pending() == 0) {
+            probing = false;
+            return;
+        }
+        // The previous probe is still queued after a whole period: the latency is over the threshold
+        if (probing.exchange(true)) {
+            grow();
+            return;
+        }
+        // The probe skips the admission and the capacity, it never delays nor evicts a user task.
+        // Dropped by DropOldest, it leaves probing set and the pool grows: the queue is overloaded anyway.
+        ++probes;
+        OnAbandon abandon([this]() { --probes; });
+        dispatch(Task([this, abandon = std::move(abandon)]() mutable {
+            abandon.release();
+            --probes;
+            probing = false;
+        }));
+    }
+
+    void grow()
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        if (stopping || alive == workers.size())
+            return;
+        size_t index = 0;
+        while (workers[index]->running)
+            ++index;
+        workers[index]->running = true;
+        ++alive;
+        ++grown;
+        // Every slot runs: the monitor stops until an executor retires
+        if (alive == workers.size())
+            monitoring.cancel();
+        // The slot may still hold a retired thread, it has already left its loop
+        std::thread previous = std::move(executors[index]);
+        executors[index] = std::thread(&BasicThreadPool::execute_thread, this, index);
+        lock.unlock();
+        if (previous.joinable())
+            previous.join();
+    }
+
+    // Called with the mutex acquired, after an idle keep-alive
+    bool retire(Worker& worker)
+    {
+        if (alive <= minimum || stopping)
+            return false;
+        worker.running = false;
+        if (alive-- == workers.size())
+            arm_monitor();
+        ++retired;
+        return true;
+    }
+    // END
+
+    // WAIT-TASK
+    // False when the executor retires
+    bool wait_task(Worker& worker)
     {
+        // Spin first: a task arriving soon is started without any syscall
+        auto start = clock::now();
+        auto now = start;
+        while (!has_task() && !stopping && now - start < worker.spin_budget) {
+            std::this_thread::yield();
+            now = clock::now();
+        }
+        worker.spinning.fetch_add((now - start).count(), std::memory_order_relaxed);
+        if (has_task() || stopping) {
+            worker.spin_budget = std::min<std::chrono::nanoseconds>(worker.spin_budget * 2 + std::chrono::microseconds(1), options.spin);
+            return true;
+        }
+        // Spinning was useless, spin less next time
+        worker.spin_budget /= 2;
+
+        // Then park: the predicate is checked under the mutex so no notification is lost
         std::unique_lock<std::mutex> notif { mutex };
-        pool.notify_one();
+        auto ready = [this]() { return has_task() || stopping; };
+        bool woken = true;
+        ++idle;
+        if (alive > minimum)
+            woken = waiter.wait_for(notif, options.keep_alive, ready);
+        else
+            waiter.wait(notif, ready);
+        --idle;
+        // Idle for the whole keep-alive above the lower bound: the executor retires
+        if (!woken && retire(worker))
+            return false;
+        notif.unlock();
+        auto parked = clock::now() - now;
+        worker.parked.fetch_add(parked.count(), std::memory_order_relaxed);
+        worker.parks.fetch_add(1, std::memory_order_relaxed);
+        // Woken early enough for a spin to catch the task: spin more next time
+        if (parked < options.spin)
+            worker.spin_budget = std::min<std::chrono::nanoseconds>(worker.spin_budget * 2 + std::chrono::microseconds(1), options.spin);
+        return true;
+    }
+
+    // EXECUTE-THREAD
+    void execute_thread(size_t index)
+    {
+        context() = Context { this, index };
+        Worker& worker = *workers[index];
+        if (!options.cpus.empty())
+            pin_current_thread(options.cpus);
+        {
+            std::lock_guard<std::mutex> notif { mutex };
+            if (++started == minimum)
+                pool.notify_one();
+        }
+
+        while (true) {
+            while (auto entry = next_task(index)) {
+                run_entry(entry, workers[index].get());
+                if (stopping && options.shutdown == Shutdown::Cancel)
+                    break;
+            }
+            if (stopping || !wait_task(worker))
+                break;
+        }
+        context() = Context();
+    }
+    // END
+};
 
+// FUTURE
+template<typename T>
+struct FutureState
+{
+    using Value = std::conditional_t<std::is_void<T>::value, bool, T>;
+
+    std::mutex mutex;                           // Mutex for the result
+    std::condition_variable done;               // Notify the result
+    std::atomic<bool> ready { false };          // Result or exception available
+    std::optional<Value> value;                 // Result of the task
+    std::exception_ptr exception;               // Exception thrown by the task
+    std::vector<Task> continuations;            // Tasks waiting for the result
+
+    template<typename Pool, typename F, typename... Args>
+    void fulfil(Pool& pool, F&& function, Args&&... args)
+    {
         try {
-            while (true) {
-                waiter.wait(notif);
-                while (auto task = get_task()) {
-                    notif.unlock();
-                    (*task)();
-                    notif.lock();
+            if constexpr (std::is_void<T>::value) {
+                std::invoke(std::forward<F>(function), std::forward<Args>(args)...);
+                value.emplace(true);
+            } else {
+                value.emplace(std::invoke(std::forward<F>(function), std::forward<Args>(args)...));
+            }
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        complete(pool);
+    }
+
+    // The task was destroyed without running: get() throws std::future_error(broken_promise)
+    template<typename Pool>
+    void abandon(Pool& pool)
+    {
+        exception = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+        complete(pool);
+    }
+
+    template<typename Pool>
+    void complete(Pool& pool)
+    {
+        std::vector<Task> pending;
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            ready = true;
+            pending.swap(continuations);
+        }
+        done.notify_all();
+        if (!pending.empty())
+            pool.schedule(std::move(pending));
+    }
+};
+
+template<typename T, typename Pool>
+class Future final
+{
+public:
+    Future() = default;
+    Future(Pool& pool, std::shared_ptr<FutureState<T>> state) : pool(&pool), state(std::move(state)) {}
+
+    bool valid() const noexcept { return (bool)state; }
+    bool ready() const noexcept { return state->ready; }
+
+    void wait() const
+    {
+        if (pool->is_worker()) {
+            // Run other tasks instead of blocking the executor
+            while (!state->ready) {
+                if (!pool->execute()) {
+                    std::unique_lock<std::mutex> lock { state->mutex };
+                    state->done.wait_for(lock, std::chrono::microseconds(100), [this]() { return state->ready.load(); });
                 }
             }
-        } catch (const std::exception&) {}
+            return;
+        }
+        std::unique_lock<std::mutex> lock { state->mutex };
+        state->done.wait(lock, [this]() { return state->ready.load(); });
     }
-    // END
+
+    T get()
+    {
+        wait();
+        auto result = std::move(state);
+        if (result->exception)
+            std::rethrow_exception(result->exception);
+        if constexpr (!std::is_void<T>::value)
+            return std::move(*result->value);
+    }
+
+    // Consume the future, the continuation receives its result on the pool
+    template<typename F>
+    auto then(F&& continuation)
+    {
+        using Result = typename std::conditional_t<std::is_void<T>::value,
+            std::invoke_result<std::decay_t<F>>, std::invoke_result<std::decay_t<F>, T>>::type;
+        auto next = std::make_shared<FutureState<Result>>();
+        OnAbandon abandon([pool = pool, next]() { next->abandon(*pool); });
+        Task task([pool = pool, source = state, next, continuation = std::forward<F>(continuation), abandon = std::move(abandon)]() mutable {
+            abandon.release();
+            if (source->exception) {
+                next->fulfil(*pool, [exception = source->exception]() -> Result { std::rethrow_exception(exception); });
+            } else if constexpr (std::is_void<T>::value) {
+                next->fulfil(*pool, continuation);
+            } else {
+                next->fulfil(*pool, continuation, std::move(*source->value));
+            }
+        });
+        {
+            std::lock_guard<std::mutex> lock { state->mutex };
+            if (!state->ready) {
+                state->continuations.push_back(std::move(task));
+                task = Task();
+            }
+        }
+        if (task)
+            pool->schedule(std::move(task));
+        state.reset();
+        return Future<Result, Pool>(*pool, std::move(next));
+    }
+
+private:
+    Pool* pool = nullptr;
+    std::shared_ptr<FutureState<T>> state;
 };
+
+template<typename Queue>
+template<typename F, typename... Args>
+auto BasicThreadPool<Queue>::submit(F&& function, Args&&... args) -> Future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>, BasicThreadPool>
+{
+    using Result = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+    auto state = std::make_shared<FutureState<Result>>();
+    OnAbandon abandon([this, state]() { state->abandon(*this); });
+    schedule(Task([this, state, function = std::forward<F>(function), args = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...), abandon = std::move(abandon)]() mutable {
+        abandon.release();
+        std::apply([&](auto&... unpacked) { state->fulfil(*this, function, std::move(unpacked)...); }, args);
+    }));
+    return Future<Result, BasicThreadPool>(*this, std::move(state));
+}
+// END
 } /* !namespace thread_pool */
\ No newline at end of file
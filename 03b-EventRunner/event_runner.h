@@ -1,111 +1,1028 @@
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <ostream>
+#include <ranges>
+#include <span>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <condition_variable>
 
+// Publish timestamps and per-runner latency histograms (0: compiled out)
+#ifndef EVENT_RUNNER_METRICS
+#define EVENT_RUNNER_METRICS 0
+#endif
+
 namespace event_runner {
-struct IEvent { virtual ~IEvent() = default; };
-using SharedEvent = std::shared_ptr<IEvent>;
+// EVENT-TYPE
+// Compact ids given to the event types on first use, they index the dispatch tables
+inline size_t next_event_type()
+{
+    static std::atomic<size_t> counter { 0 };
+    return counter++;
+}
+
+template<typename E>
+size_t event_type()
+{
+    static const size_t type = next_event_type();
+    return type;
+}
+
+constexpr size_t untyped_event = SIZE_MAX;
+
+template<typename E>
+class EventPtr;
+
+struct IEvent
+{
+    IEvent() = default;
+    virtual ~IEvent() = default;
+
+    const size_t type = untyped_event;          // Type id, untyped events reach no typed handler
+
+protected:
+    explicit IEvent(size_t type) : type(type) {}
+
+private:
+    template<typename E>
+    friend class EventPtr;
+
+    // Called by the last handle released, a pooled event gives its storage back to its pool
+    virtual void recycle() { delete this; }
+
+    std::atomic<size_t> references { 0 };       // Handles on the event, intrusive: no control block
+};
+
+// Base of the concrete events, stamps their type id once at construction
+template<typename E>
+struct Event : public IEvent
+{
+    Event() : IEvent(event_type<E>()) {}
+};
+// END
+
+constexpr size_t cache_line = 64;
+
+// EVENT-PTR
+// Intrusive handle on an event: the count lives in the event, beside its data, and a copy sent to
+// a runner touches no separate control block
+template<typename E>
+class EventPtr final
+{
+public:
+    EventPtr() = default;
+    EventPtr(std::nullptr_t) {}
+    explicit EventPtr(E* event) : event(event) { acquire(); }
+    EventPtr(const EventPtr& other) : EventPtr(other.event) {}
+    EventPtr(EventPtr&& other) noexcept : event(std::exchange(other.event, nullptr)) {}
+
+    template<typename D, typename = std::enable_if_t<std::is_convertible<D*, E*>::value>>
+    EventPtr(const EventPtr<D>& other) : EventPtr(other.get()) {}
+    template<typename D, typename = std::enable_if_t<std::is_convertible<D*, E*>::value>>
+    EventPtr(EventPtr<D>&& other) noexcept : event(std::exchange(other.event, nullptr)) {}
+
+    ~EventPtr() { reset(); }
+
+    EventPtr& operator=(EventPtr other) noexcept
+    {
+        std::swap(event, other.event);
+        return *this;
+    }
+
+    void reset()
+    {
+        IEvent* released = std::exchange(event, nullptr);
+        if (released != nullptr && released->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            released->recycle();
+    }
+
+    E* get() const { return event; }
+    E& operator*() const { return *event; }
+    E* operator->() const { return event; }
+    explicit operator bool() const { return event != nullptr; }
+    bool operator==(const EventPtr& other) const { return event == other.event; }
+
+private:
+    template<typename D>
+    friend class EventPtr;
+
+    void acquire()
+    {
+        if (event != nullptr)
+            static_cast<IEvent*>(event)->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    E* event = nullptr;
+};
+
+// Heap allocated event, deleted with its last handle
+template<typename E, typename... Args>
+EventPtr<E> make_event(Args&&... args)
+{
+    return EventPtr<E>(new E(std::forward<Args>(args)...));
+}
+// END
+
+using SharedEvent = EventPtr<IEvent>;
 using EventFunction = std::function<void(const IEvent&)>;
+using EventSpan = std::span<const SharedEvent>;
+
+// EVENT-POOL
+// Pooled events of one type: the last handle released destroys the event and gives its block back.
+// A freed block holds the link to the next free one (FreeBlock). The thread constructing the pool pops
+// its local list, the other threads allocate. Any thread releases: the block is pushed on a lock-free
+// stack the owner takes whole when its list runs dry, a stack never popped by parts has no ABA.
+// The shared state is counted by the pool and by its live events, the pool can be destroyed first.
+template<typename E>
+class EventPool final
+{
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct State
+    {
+        ~State()
+        {
+            free_blocks(local);
+            free_blocks(returned.load(std::memory_order_acquire));
+        }
+
+        // Any thread, the last reference frees the blocks
+        void release(void* block)
+        {
+            FreeBlock* freed = new (block) FreeBlock { returned.load(std::memory_order_relaxed) };
+            while (!returned.compare_exchange_weak(freed->next, freed, std::memory_order_release, std::memory_order_relaxed))
+                ;
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+
+        static void free_blocks(FreeBlock* block)
+        {
+            while (block != nullptr)
+                ::operator delete(std::exchange(block, block->next));
+        }
+
+        std::atomic<size_t> references { 1 };   // The pool and its live events
+        std::atomic<size_t> allocations { 0 };
+        FreeBlock* local = nullptr;             // Free list of the owner thread, linked through the blocks
+        alignas(cache_line) std::atomic<FreeBlock*> returned { nullptr }; // Blocks released by any thread
+    };
+
+    struct Pooled final : E
+    {
+        template<typename... Args>
+        Pooled(State* state, Args&&... args) : E(std::forward<Args>(args)...), state(state) {}
+
+        void recycle() override
+        {
+            State* owner = state;
+            this->~Pooled();
+            owner->release(this);
+        }
+
+        State* const state;
+    };
+
+    static_assert(alignof(Pooled) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Over-aligned events are not pooled");
+    static_assert(sizeof(Pooled) >= sizeof(FreeBlock));
+
+public:
+    EventPool() : state(new State), owner(std::this_thread::get_id()) {}
+    EventPool(const EventPool&) = delete;
+
+    ~EventPool()
+    {
+        if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete state;
+    }
+
+    template<typename... Args>
+    EventPtr<E> make(Args&&... args)
+    {
+        void* block = acquire();
+        state->references.fetch_add(1, std::memory_order_relaxed);
+        try {
+            return EventPtr<E>(new (block) Pooled(state, std::forward<Args>(args)...));
+        } catch (...) {
+            state->release(block);
+            throw;
+        }
+    }
+
+    // Blocks taken from the allocator, the others were recycled
+    size_t allocated() const { return state->allocations; }
+
+private:
+    void* acquire()
+    {
+        if (owner == std::this_thread::get_id()) {
+            if (state->local == nullptr)
+                state->local = state->returned.exchange(nullptr, std::memory_order_acquire);
+            if (FreeBlock* block = state->local) {
+                state->local = block->next;
+                return block;
+            }
+        }
+        state->allocations.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(sizeof(Pooled));
+    }
+
+    State* const state;
+    const std::thread::id owner;                // Only thread popping the free blocks
+};
+// END
+
+// DISPATCHER
+template<typename H>
+struct HandlerTraits;
+
+template<typename E>
+struct HandlerTraits<void (*)(const E&)> { using Event = E; };
+
+// Handlers registered per concrete event type, stored in one flat table sorted by type id.
+// Registration must be done before the events are dispatched.
+struct Dispatcher final
+{
+    using Handler = void (*)(const IEvent&);
+
+    template<auto H>
+    Dispatcher& on()
+    {
+        using E = typename HandlerTraits<decltype(H)>::Event;
+        // The type id is stamped by Event<E>: a handler of IEvent or of another base would never be called
+        static_assert(std::is_base_of_v<Event<E>, E>, "Handlers take a concrete event deriving from Event<E>");
+        size_t type = event_type<E>();
+        if (offsets.size() < type + 2)
+            offsets.resize(type + 2, offsets.empty() ? 0 : offsets.back());
+        // The cast is checked by the type id, no RTTI is needed
+        handlers.insert(handlers.begin() + offsets[type + 1], [](const IEvent& event) { H(static_cast<const E&>(event)); });
+        for (size_t next = type + 1; next < offsets.size(); ++next)
+            ++offsets[next];
+        return *this;
+    }
+
+    void operator()(const IEvent& event) const
+    {
+        // An untyped event has the largest id, type + 1 would wrap around
+        if (event.type == untyped_event || event.type + 1 >= offsets.size())
+            return;
+        for (uint32_t index = offsets[event.type]; index < offsets[event.type + 1]; ++index)
+            handlers[index](event);
+    }
+
+private:
+    std::vector<Handler> handlers;              // Handlers of type i in [offsets[i], offsets[i + 1])
+    std::vector<uint32_t> offsets;
+};
+
+// Runner handlers are functions taking the event, or pointers to a callable such as a Dispatcher
+template<auto F>
+void handle(const IEvent& event)
+{
+    using Handler = decltype(F);
+    if constexpr (std::is_pointer<Handler>::value && std::is_class<std::remove_pointer_t<Handler>>::value)
+        (*F)(event);
+    else
+        F(event);
+}
+
+// BATCH-HANDLER
+// A batch handler takes every drained event at once and amortises its per-call costs
+template<auto F>
+constexpr bool is_batch_handler()
+{
+    using Handler = decltype(F);
+    if constexpr (std::is_pointer<Handler>::value && std::is_class<std::remove_pointer_t<Handler>>::value)
+        return std::is_invocable<std::remove_pointer_t<Handler>&, EventSpan>::value;
+    else
+        return std::is_invocable<Handler, EventSpan>::value;
+}
+
+template<auto F>
+void handle_batch(EventSpan batch)
+{
+    if constexpr (!is_batch_handler<F>()) {
+        for (const auto& event : batch)
+            handle<F>(*event);
+    } else if constexpr (std::is_pointer<decltype(F)>::value && std::is_class<std::remove_pointer_t<decltype(F)>>::value) {
+        (*F)(batch);
+    } else {
+        F(batch);
+    }
+}
+// END
 
-struct StopException : public std::exception {};
+// LATENCY
+inline int64_t steady_nanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Queue entry of a runner. The metrics stamp the entry and not the event: an event scheduled several
+// times, or on several runners, has one queue delay per schedule.
+struct Queued
+{
+    SharedEvent event;
+#if EVENT_RUNNER_METRICS
+    int64_t published = steady_nanoseconds();
+#endif
+};
+
+// HDR-style histogram: 8 linear sub-buckets per power of two, a value is within 12.5% of its bucket bound
+struct LatencyHistogram
+{
+    static constexpr size_t sub_bucket_bits = 3;
+    static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+    static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    std::array<std::atomic<size_t>, bucket_count> buckets {};
+
+    static size_t bucket(uint64_t nanoseconds)
+    {
+        if (nanoseconds < sub_bucket_count)
+            return nanoseconds;
+        size_t exponent = std::bit_width(nanoseconds) - 1;
+        size_t sub_bucket = (nanoseconds >> (exponent - sub_bucket_bits)) & (sub_bucket_count - 1);
+        return (exponent - sub_bucket_bits + 1) * sub_bucket_count + sub_bucket;
+    }
+
+    // Highest value counted by the bucket
+    static uint64_t upper_bound(size_t index)
+    {
+        if (index < sub_bucket_count)
+            return index;
+        size_t shift = index / sub_bucket_count - 1;
+        uint64_t lower = (sub_bucket_count + index % sub_bucket_count) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    void record(int64_t nanoseconds)
+    {
+        buckets[bucket(std::max<int64_t>(nanoseconds, 0))].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the quantile (0 < quantile <= 1)
+    std::chrono::nanoseconds percentile(double quantile) const
+    {
+        size_t count = 0;
+        for (const auto& bucket : buckets)
+            count += bucket.load(std::memory_order_relaxed);
+        if (count == 0)
+            return {};
+        size_t rank = size_t(quantile * (count - 1)) + 1;
+        size_t seen = 0;
+        size_t index = 0;
+        for (; index < bucket_count - 1; ++index) {
+            seen += buckets[index].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                break;
+        }
+        return std::chrono::nanoseconds(std::min<uint64_t>(upper_bound(index), INT64_MAX));
+    }
+};
+
+struct Percentiles
+{
+    std::chrono::nanoseconds p50 {};
+    std::chrono::nanoseconds p99 {};
+    std::chrono::nanoseconds p999 {};
+};
+
+// Latency of one runner, empty when the metrics are compiled out
+struct LatencySnapshot
+{
+    size_t handled = 0;
+    Percentiles queue_delay;                    // From the schedule to the executor taking the event
+    Percentiles handler;                        // Handler call, a whole batch for batch handlers
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Percentiles& percentiles)
+{
+    return out << "p50 " << percentiles.p50.count() << "ns, p99 " << percentiles.p99.count()
+               << "ns, p999 " << percentiles.p999.count() << "ns";
+}
+
+inline std::ostream& operator<<(std::ostream& out, const LatencySnapshot& snapshot)
+{
+    return out << snapshot.handled << " events, queue delay " << snapshot.queue_delay
+               << ", handler " << snapshot.handler;
+}
+
+struct RunnerMetrics
+{
+    std::atomic<size_t> handled { 0 };
+    LatencyHistogram queue_delay;
+    LatencyHistogram handler;
+
+    LatencySnapshot snapshot() const
+    {
+        auto percentiles = [](const LatencyHistogram& histogram) {
+            return Percentiles { histogram.percentile(0.5), histogram.percentile(0.99), histogram.percentile(0.999) };
+        };
+        return LatencySnapshot { handled.load(), percentiles(queue_delay), percentiles(handler) };
+    }
+};
+
+// Times the handler calls, only called by the runners when the metrics are compiled in
+template<auto F>
+void handle_measured(RunnerMetrics& metrics, const IEvent& event)
+{
+    int64_t start = steady_nanoseconds();
+    handle<F>(event);
+    metrics.handler.record(steady_nanoseconds() - start);
+    metrics.handled.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<auto F>
+void handle_measured(RunnerMetrics& metrics, EventSpan batch)
+{
+    if constexpr (is_batch_handler<F>()) {
+        int64_t start = steady_nanoseconds();
+        handle_batch<F>(batch);
+        metrics.handler.record(steady_nanoseconds() - start);
+        metrics.handled.fetch_add(batch.size(), std::memory_order_relaxed);
+    } else {
+        for (const auto& event : batch)
+            handle_measured<F>(metrics, *event);
+    }
+}
+// END
 
 template<auto F>
 struct ThreadPool final
 {
+    // WORKER
+    // Keyed events are routed to one executor, which handles them in scheduling order
+    struct Entry
+    {
+        Queued queued;
+        uint64_t key = 0;
+        bool coalesced = false;                 // The key is in pending until the event is taken
+    };
+
+    struct Worker
+    {
+        std::deque<Entry> events;               // Keyed events of this executor
+        std::condition_variable waiter;         // Notify incomming jobs
+        bool idle = false;                      // Waiting on the waiter, under the mutex
+        std::unordered_map<uint64_t, uint64_t> pending; // Queued coalesced key to its absolute position
+        uint64_t popped = 0;                    // Events taken from the front of the queue
+    };
+    // END
+
     // DATA
     std::mutex mutex;                           // Mutex for incomming jobs
-    std::condition_variable waiter;             // Notify incomming jobs
     std::condition_variable pool;               // Notify thread creation
+    std::vector<std::unique_ptr<Worker>> workers; // One local queue per executor
     std::vector<std::thread> executors;         // Executor threads
-    std::deque<SharedEvent> events;             // Event collection
+    std::deque<Queued> events;                  // Event collection
     std::atomic_bool running = true;
+    size_t started = 0;                         // Executors started, under the mutex
+    const size_t batch_size;                    // Most events taken under one lock acquisition
+    std::atomic<size_t> coalesced { 0 };
+#if EVENT_RUNNER_METRICS
+    RunnerMetrics metrics;                      // Latency of the handled events
+#endif
 
     // CTOR
-    ThreadPool(int count)
+    ThreadPool(int count, size_t batch_size = 1) : batch_size(std::max<size_t>(batch_size, 1))
     {
+        for (int index = 0; index < count; ++index)
+            workers.push_back(std::make_unique<Worker>());
         std::unique_lock<std::mutex> notif { mutex };
-        for (; count > 0; --count) {
-            executors.push_back(std::thread(&ThreadPool::execute_thread, this));
-            pool.wait(notif);
+        for (size_t index = 0; index < workers.size(); ++index) {
+            executors.push_back(std::thread(&ThreadPool::execute_thread, this, index));
+            pool.wait(notif, [&]() { return started == executors.size(); });
         }
     }
 
     // DTOR
     ~ThreadPool()
     {
-        running = false;
-        waiter.notify_all();
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            running = false;
+            for (auto& worker : workers)
+                worker->waiter.notify_one();
+        }
         for (auto& executor : executors) {
             executor.join();
         }
-        while (auto event = get_event()) {
-            F(*event);
+        std::vector<SharedEvent> batch;
+        for (auto& worker : workers) {
+            while (get_events(*worker, batch) != 0) {
+                handle_events(batch);
+                batch.clear();
+            }
+        }
+        while (get_events(batch) != 0) {
+            handle_events(batch);
+            batch.clear();
         }
     }
 
     // SCHEDULE
-    template<typename C>
+    template<std::ranges::range C>
     void schedule(C&& coll)
     {
         std::lock_guard<std::mutex> lock { mutex };
-        for (auto& event : coll)
-            events.push_back(event);
-        waiter.notify_all();
+        size_t count = 0;
+        for (auto& event : coll) {
+            events.push_back(Queued { event });
+            ++count;
+        }
+        wake(count);
     }
     
     void schedule(const SharedEvent& event)
     {
+        Queued queued { event };
         std::lock_guard<std::mutex> lock { mutex };
-        events.push_back(event);
-        waiter.notify_one();
+        events.push_back(std::move(queued));
+        wake(1);
     }
+    // END
 
-    // EXECUTE
-    bool execute()
+    // SCHEDULE-KEYED
+    // Events sharing a key are handled in order, distinct keys run in parallel
+    void schedule(const SharedEvent& event, uint64_t key)
+    {
+        Queued queued { event };
+        std::lock_guard<std::mutex> lock { mutex };
+        if (workers.empty()) {
+            events.push_back(std::move(queued));
+            return;
+        }
+        Worker& worker = *workers[partition(key)];
+        worker.events.push_back(Entry { std::move(queued), key });
+        worker.waiter.notify_one();
+    }
+
+    // Fibonacci hashing spreads sequential keys over every executor
+    size_t partition(uint64_t key) const
+    {
+        return ((key * 0x9E3779B97F4A7C15ull) >> 32) % workers.size();
+    }
+    // END
+
+    // COALESCE
+    // Opt-in for "entity changed" events: a pending event of the same key is replaced in place, or merged
+    // with merge(pending, newer). A key is either coalesced or scheduled, not both.
+    void coalesce(const SharedEvent& event, uint64_t key)
+    {
+        Queued queued { event };
+        std::lock_guard<std::mutex> lock { mutex };
+        if (workers.empty()) {
+            events.push_back(std::move(queued));
+            return;
+        }
+        Worker& worker = *workers[partition(key)];
+        // The newer event keeps the queue position and the stamp of the pending one
+        if (SharedEvent* pending = pending_event(worker, key)) {
+            *pending = event;
+            ++coalesced;
+            return;
+        }
+        push_coalesced(worker, std::move(queued), key);
+    }
+
+    // The merge runs outside the mutex, it is retried if the pending event was taken or replaced meanwhile
+    template<typename M>
+    void coalesce(const SharedEvent& event, uint64_t key, M&& merge)
     {
+        Queued queued { event };
         std::unique_lock<std::mutex> lock { mutex };
-        if (auto event = get_event()) {
+        if (workers.empty()) {
+            events.push_back(std::move(queued));
+            return;
+        }
+        Worker& worker = *workers[partition(key)];
+        for (SharedEvent* pending; (pending = pending_event(worker, key)) != nullptr;) {
+            SharedEvent current = *pending;
             lock.unlock();
-            F(event);
-            return true;
+            SharedEvent merged = merge(std::as_const(current), event);
+            lock.lock();
+            pending = pending_event(worker, key);
+            if (pending != nullptr && *pending == current) {
+                *pending = std::move(merged);
+                ++coalesced;
+                return;
+            }
         }
-        return false;
+        push_coalesced(worker, std::move(queued), key);
+    }
+
+    // Events absorbed by a pending one
+    size_t coalesced_count() const { return coalesced; }
+
+    // Coalesced keys still queued, a key is forgotten once its event is taken by the executor
+    size_t pending_keys()
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        size_t count = 0;
+        for (auto& worker : workers)
+            count += worker->pending.size();
+        return count;
     }
     // END
 
+    // Percentiles since the construction, taken while the runner is handling events
+    LatencySnapshot latency() const
+    {
+#if EVENT_RUNNER_METRICS
+        return metrics.snapshot();
+#else
+        return {};
+#endif
+    }
+
+    // EXECUTE
+    bool execute()
+    {
+        return execute(1) != 0;
+    }
+
+    // Caller-runs: the producer helps draining up to limit unkeyed events, one batch per lock acquisition.
+    // Keyed events stay on their executor to keep their order.
+    size_t execute(size_t limit)
+    {
+        // The batch buffer of the calling thread is reused across calls, a nested call gets an empty one
+        static thread_local std::vector<SharedEvent> scratch;
+        std::vector<SharedEvent> batch;
+        batch.swap(scratch);
+        size_t handled = 0;
+        while (handled < limit) {
+            {
+                std::lock_guard<std::mutex> lock { mutex };
+                if (move_events(events, batch, std::min(batch_size, limit - handled)) == 0)
+                    break;
+            }
+            handle_events(batch);
+            handled += batch.size();
+            batch.clear();
+        }
+        scratch.swap(batch);
+        return handled;
+    }
+    // END
 private:
-    SharedEvent get_event()
+    // Called with the mutex acquired: unkeyed events go to any idle executor
+    void wake(size_t count)
     {
-        if (events.empty())
-            return SharedEvent();
-        SharedEvent item { std::move(events.front()) };
-        events.pop_front();
-        return item;
+        for (auto& worker : workers) {
+            if (count == 0)
+                break;
+            if (worker->idle) {
+                worker->idle = false;
+                worker->waiter.notify_one();
+                --count;
+            }
+        }
+    }
+
+    // Called with the mutex acquired, the queue delay ends when an executor takes the event
+    size_t move_events(std::deque<Queued>& from, std::vector<SharedEvent>& batch, size_t count)
+    {
+        count = std::min(from.size(), count);
+#if EVENT_RUNNER_METRICS
+        int64_t taken = count != 0 ? steady_nanoseconds() : 0;
+        for (size_t index = 0; index < count; ++index)
+            metrics.queue_delay.record(taken - from[index].published);
+#endif
+        for (size_t index = 0; index < count; ++index)
+            batch.push_back(std::move(from[index].event));
+        from.erase(from.begin(), from.begin() + count);
+        return count;
+    }
+
+    size_t get_events(std::vector<SharedEvent>& batch)
+    {
+        return move_events(events, batch, batch_size);
+    }
+
+    // Keyed events first, the batch is completed with unkeyed ones
+    size_t get_events(Worker& worker, std::vector<SharedEvent>& batch)
+    {
+        size_t count = std::min(worker.events.size(), batch_size);
+#if EVENT_RUNNER_METRICS
+        int64_t taken = count != 0 ? steady_nanoseconds() : 0;
+#endif
+        for (size_t index = 0; index < count; ++index) {
+            Entry& entry = worker.events.front();
+            if (entry.coalesced)
+                worker.pending.erase(entry.key);
+#if EVENT_RUNNER_METRICS
+            metrics.queue_delay.record(taken - entry.queued.published);
+#endif
+            batch.push_back(std::move(entry.queued.event));
+            worker.events.pop_front();
+        }
+        worker.popped += count;
+        return count + move_events(events, batch, batch_size - count);
+    }
+
+    // Queued event of a coalesced key, nullptr once the executor took it
+    SharedEvent* pending_event(Worker& worker, uint64_t key)
+    {
+        auto pending = worker.pending.find(key);
+        if (pending == worker.pending.end())
+            return nullptr;
+        return &worker.events[pending->second - worker.popped].queued.event;
+    }
+
+    void push_coalesced(Worker& worker, Queued&& queued, uint64_t key)
+    {
+        worker.pending.emplace(key, worker.popped + worker.events.size());
+        worker.events.push_back(Entry { std::move(queued), key, true });
+        worker.waiter.notify_one();
+    }
+
+    void handle_events(EventSpan batch)
+    {
+#if EVENT_RUNNER_METRICS
+        handle_measured<F>(metrics, batch);
+#else
+        handle_batch<F>(batch);
+#endif
     }
 
     // EXECUTE-THREAD
-    void execute_thread()
+    void execute_thread(size_t index)
     {
+        Worker& worker = *workers[index];
         std::unique_lock<std::mutex> notif { mutex };
+        ++started;
         pool.notify_one();
-
-        try {
-            while (running) {
-                waiter.wait(notif);
-                while (auto event = get_event()) {
-                    notif.unlock();
-                    F(*event);
-                    notif.lock();
-                }
+        std::vector<SharedEvent> batch;
+        batch.reserve(batch_size);
+        while (running) {
+            worker.idle = true;
+            worker.waiter.wait(notif, [&]() {
+                return !running || !worker.events.empty() || !events.empty();
+            });
+            worker.idle = false;
+            while (get_events(worker, batch) != 0) {
+                notif.unlock();
+                // A throwing handler loses the rest of its batch, the executor keeps its keyed events
+                try {
+                    handle_events(batch);
+                } catch (const std::exception&) {}
+                batch.clear();
+                notif.lock();
             }
-            notif.unlock();
-        } catch (const std::exception&) {}
+        }
     }
     // END
 };
-} /* !namespace event_runner */
\ No newline at end of file
+
+// BROADCAST-LOG
+// Append-only ring of events read by every consumer at its own pace (disruptor style).
+// A publication is one slot write, each consumer owns a cursor on its own cache line.
+template<size_t Capacity = 1024>
+struct BroadcastLog final
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+    static constexpr uint64_t detached = UINT64_MAX;
+
+    explicit BroadcastLog(size_t max_consumers = 8) : cursors(new Cursor[max_consumers]), max_consumers(max_consumers)
+    {
+        for (size_t position = 0; position < Capacity; ++position)
+            slots[position].sequence.store(0, std::memory_order_relaxed);
+    }
+
+    // The consumer reads the events published after its subscription, the cursors released by unsubscribe
+    // are reused. A subscription excludes the gate refreshes: a refresh scanning the cursors before this
+    // one is visible would otherwise move the gate past its start position.
+    size_t subscribe()
+    {
+        std::lock_guard<std::mutex> lock { subscription };
+        for (size_t consumer = 0; consumer < max_consumers; ++consumer) {
+            if (cursors[consumer].used.load(std::memory_order_acquire))
+                continue;
+            cursors[consumer].used.store(true, std::memory_order_relaxed);
+            cursors[consumer].position = claimed.load();
+            if (consumer_count.load() <= consumer)
+                consumer_count.store(consumer + 1);
+            // Producers that claimed before the cursor was scanned may have trusted a gate without it:
+            // the consumer starts after their positions. The producers claiming later see the cursor.
+            cursors[consumer].position = claimed.load();
+            return consumer;
+        }
+        throw std::length_error("event_runner: too many consumers");
+    }
+
+    // A detached consumer no longer gates the producers, its cursor can be claimed again
+    void unsubscribe(size_t consumer)
+    {
+        cursors[consumer].position = detached;
+        cursors[consumer].used.store(false, std::memory_order_release);
+        wake();
+    }
+
+    // Multiple producers claim a position, then wait for the slowest consumer to leave the slot
+    void publish(SharedEvent event)
+    {
+#if EVENT_RUNNER_METRICS
+        int64_t published = steady_nanoseconds();
+#endif
+        uint64_t position = claimed.fetch_add(1);
+        if (position >= Capacity && gate.load(std::memory_order_acquire) <= position - Capacity) {
+            ++gated;
+            while (min_cursor() <= position - Capacity)
+                std::this_thread::yield();
+            // The gate is recomputed under the subscription mutex, a new cursor is either scanned or starts
+            // after the claimed positions read here. Without consumer the minimum is detached: the gate
+            // stays below the claimed positions.
+            std::lock_guard<std::mutex> lock { subscription };
+            uint64_t minimum = std::min(min_cursor(), claimed.load());
+            uint64_t cached = gate.load(std::memory_order_relaxed);
+            while (cached < minimum && !gate.compare_exchange_weak(cached, minimum))
+                ;
+        }
+        Slot& slot = slots[position & (Capacity - 1)];
+        // The producer of the previous lap may still be writing when no consumer gates it
+        while (position >= Capacity && slot.sequence.load(std::memory_order_acquire) != position - Capacity + 1)
+            std::this_thread::yield();
+        slot.event = std::move(event);
+#if EVENT_RUNNER_METRICS
+        slot.published = published;
+#endif
+        slot.sequence.store(position + 1);
+        if (parked != 0)
+            wake();
+    }
+
+    // Event at the cursor of the consumer, nullptr when not published yet
+    const IEvent* peek(size_t consumer) const
+    {
+        uint64_t position = cursors[consumer].position.load(std::memory_order_relaxed);
+        const Slot& slot = slots[position & (Capacity - 1)];
+        // Sequentially consistent with parked: a parking consumer sees the event or the producer sees it parked
+        if (slot.sequence.load() != position + 1)
+            return nullptr;
+        return slot.event.get();
+    }
+
+#if EVENT_RUNNER_METRICS
+    // Publication time of the event returned by peek
+    int64_t published(size_t consumer) const
+    {
+        return slots[cursors[consumer].position.load(std::memory_order_relaxed) & (Capacity - 1)].published;
+    }
+#endif
+
+    // Release the event returned by peek, the slot can be reused once every consumer released it
+    void advance(size_t consumer)
+    {
+        cursors[consumer].position.fetch_add(1, std::memory_order_release);
+    }
+
+    // Park until an event is available for the consumer or the predicate holds
+    template<typename P>
+    void wait(size_t consumer, P&& stop)
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        ++parked;
+        readable.wait(lock, [&]() { return peek(consumer) != nullptr || stop(); });
+        --parked;
+    }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        readable.notify_all();
+    }
+
+    // Slow consumer detection
+    uint64_t lag(size_t consumer) const
+    {
+        uint64_t position = cursors[consumer].position;
+        uint64_t published = claimed;
+        return position == detached || position >= published ? 0 : published - position;
+    }
+
+    size_t slowest() const
+    {
+        size_t slowest = 0;
+        for (size_t consumer = 1; consumer < consumer_count; ++consumer) {
+            if (lag(consumer) > lag(slowest))
+                slowest = consumer;
+        }
+        return slowest;
+    }
+
+    size_t gated_count() const { return gated; }
+
+private:
+    struct alignas(cache_line) Slot
+    {
+        std::atomic<uint64_t> sequence;         // Position + 1 once the event is readable
+        SharedEvent event;
+#if EVENT_RUNNER_METRICS
+        int64_t published;                      // Steady clock nanoseconds of the publication
+#endif
+    };
+
+    struct alignas(cache_line) Cursor
+    {
+        std::atomic<uint64_t> position { detached }; // Next position to read
+        std::atomic<bool> used { false };       // Claimed by a subscribed consumer
+    };
+
+    uint64_t min_cursor() const
+    {
+        uint64_t minimum = detached;
+        for (size_t consumer = 0; consumer < consumer_count; ++consumer)
+            minimum = std::min(minimum, cursors[consumer].position.load(std::memory_order_acquire));
+        return minimum;
+    }
+
+    std::array<Slot, Capacity> slots;
+    std::unique_ptr<Cursor[]> cursors;          // One cursor per consumer
+    const size_t max_consumers;
+    std::atomic<size_t> consumer_count { 0 };   // Highest cursor ever claimed + 1
+    alignas(cache_line) std::atomic<uint64_t> claimed { 0 }; // Next position to publish
+    alignas(cache_line) std::atomic<uint64_t> gate { 0 };    // Cached slowest cursor
+    std::atomic<size_t> gated { 0 };            // Publications that waited for a slow consumer
+    std::mutex subscription;                    // Orders the subscriptions and the gate refreshes
+    std::mutex mutex;                           // Mutex for parked consumers
+    std::condition_variable readable;           // Notify published events
+    std::atomic<size_t> parked { 0 };           // Consumers waiting for events
+};
+
+// BROADCAST-RUNNER
+// One thread consuming every event of a BroadcastLog
+template<auto F, size_t Capacity = 1024>
+struct BroadcastRunner final
+{
+    BroadcastRunner(BroadcastLog<Capacity>& log) : log(log), consumer(log.subscribe())
+    {
+        executor = std::thread(&BroadcastRunner::execute_thread, this);
+    }
+
+    // The events published before the destruction are handled
+    ~BroadcastRunner()
+    {
+        stopping = true;
+        log.wake();
+        executor.join();
+        log.unsubscribe(consumer);
+    }
+
+    LatencySnapshot latency() const
+    {
+#if EVENT_RUNNER_METRICS
+        return metrics.snapshot();
+#else
+        return {};
+#endif
+    }
+
+private:
+    void execute_thread()
+    {
+        while (true) {
+            while (const IEvent* event = log.peek(consumer)) {
+#if EVENT_RUNNER_METRICS
+                metrics.queue_delay.record(steady_nanoseconds() - log.published(consumer));
+                handle_measured<F>(metrics, *event);
+#else
+                handle<F>(*event);
+#endif
+                log.advance(consumer);
+            }
+            if (stopping)
+                break;
+            log.wait(consumer, [this]() { return stopping.load(); });
+        }
+    }
+
+    BroadcastLog<Capacity>& log;
+    const size_t consumer;
+    std::atomic<bool> stopping { false };
+#if EVENT_RUNNER_METRICS
+    RunnerMetrics metrics;
+#endif
+    std::thread executor;
+};
+// END
+} /* !namespace event_runner */
@@ -1,11 +1,22 @@
+#include <array>
+#include <atomic>
 #include <iostream>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "event_runner.h"
+#include "../T3-Bencher/bencher.h"
 
 // UTILS
-static int global_id = 0;
+static std::atomic<int> global_id { 0 };
 const std::string get_id()
 {
     thread_local const std::string id = std::string("Thread ").append(std::to_string(global_id++));
@@ -19,8 +30,9 @@ void display(const std::string& val)
     std::cout << value;
 }
 
-struct Event1 : public event_runner::IEvent { mutable bool eventRan = false; };
-struct Event2 : public event_runner::IEvent { mutable bool eventRan = false; };
+struct Event1 : public event_runner::Event<Event1> { mutable std::atomic<bool> eventRan = false; };
+struct Event2 : public event_runner::Event<Event2> { mutable std::atomic<bool> eventRan = false; };
+struct LegacyEvent : public event_runner::IEvent {};
 
 void runEvent1(const event_runner::IEvent& event) {
     if (auto* event1 = dynamic_cast<const Event1*>(&event)) {
@@ -41,6 +53,21 @@ void runEvent2(const event_runner::IEvent& event) {
     }
 }
 
+// TYPED-HANDLERS
+void onEvent1(const Event1& event) {
+    display("Event1 dispatched");
+    event.eventRan = true;
+}
+
+void onEvent2(const Event2& event) {
+    display("Event2 dispatched");
+    event.eventRan = true;
+}
+
+static event_runner::Dispatcher dispatcher1 = event_runner::Dispatcher().on<onEvent1>();
+static event_runner::Dispatcher dispatcher2 = event_runner::Dispatcher().on<onEvent2>();
+// END
+
 struct Application {
     event_runner::ThreadPool<runEvent1> eventRunner1 { 1 };
     event_runner::ThreadPool<runEvent2> eventRunner2 { 1 };
@@ -50,18 +77,621 @@ struct Application {
     }
 };
 
+// DISPATCHED-APPLICATION
+struct DispatchedApplication {
+    event_runner::ThreadPool<&dispatcher1> eventRunner1 { 1 };
+    event_runner::ThreadPool<&dispatcher2> eventRunner2 { 1 };
+    void notifyAll(const event_runner::SharedEvent& event) {
+        eventRunner1.schedule(event);
+        eventRunner2.schedule(event);
+    }
+};
+// END
+
+// BROADCAST-APPLICATION
+struct BroadcastApplication {
+    event_runner::BroadcastLog<> log;
+    event_runner::BroadcastRunner<&dispatcher1> eventRunner1 { log };
+    event_runner::BroadcastRunner<&dispatcher2> eventRunner2 { log };
+    void notifyAll(event_runner::SharedEvent event) {
+        log.publish(std::move(event));
+    }
+};
+// END
+
+// A throwing handler must not strand the keyed events of its executor
+struct FailingEvent : public event_runner::Event<FailingEvent> {};
+static std::atomic<size_t> survived { 0 };
+
+void failOnce(const event_runner::IEvent& event) {
+    if (event.type == event_runner::event_type<FailingEvent>())
+        throw std::runtime_error("handler failed");
+    ++survived;
+}
+
+// BENCH-DISPATCH
+template<int I>
+struct BenchEvent : public event_runner::Event<BenchEvent<I>> {};
+
+static size_t handled = 0;
+
+template<int I>
+void castHandler(const event_runner::IEvent& event) {
+    if (dynamic_cast<const BenchEvent<I>*>(&event))
+        ++handled;
+}
+
+template<int I>
+void typedHandler(const BenchEvent<I>&) {
+    ++handled;
+}
+
+template<int... I>
+void bench_dispatch(bencher::Bencher<bencher::ExecutorState<1'000>>& bench, std::integer_sequence<int, I...>)
+{
+    constexpr size_t type_count = sizeof...(I);
+    std::vector<event_runner::SharedEvent> events;
+    for (size_t i = 0; i < 1'000; ++i) {
+        size_t type = 0;
+        ((type++ == i % type_count ? (void)events.push_back(event_runner::make_event<BenchEvent<I>>()) : (void)0), ...);
+    }
+    // Former dispatch: every handler filters every event with a dynamic_cast
+    const std::array<void (*)(const event_runner::IEvent&), type_count> fan_out { castHandler<I>... };
+    bench.bench("dynamic_cast fan-out", std::to_string(type_count), [&](auto& state) {
+        for (auto _ : state) {
+            for (const auto& event : events) {
+                for (auto handler : fan_out)
+                    handler(*event);
+            }
+        }
+    });
+    event_runner::Dispatcher dispatcher;
+    (dispatcher.on<typedHandler<I>>(), ...);
+    bench.bench("type-indexed table", std::to_string(type_count), [&](auto& state) {
+        for (auto _ : state) {
+            for (const auto& event : events)
+                dispatcher(*event);
+        }
+    });
+}
+
+void bench_dispatch()
+{
+    bencher::Bencher<bencher::ExecutorState<1'000>> bench;
+    bench_dispatch(bench, std::make_integer_sequence<int, 4>());
+    bench_dispatch(bench, std::make_integer_sequence<int, 16>());
+    bench_dispatch(bench, std::make_integer_sequence<int, 64>());
+    std::cout << "1000 x 1000 events, by event type count (" << handled << " handled)\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-BROADCAST
+struct alignas(64) Counter { std::atomic<size_t> value { 0 }; };
+static Counter counters[8];
+
+template<int I>
+void countEvent(const event_runner::IEvent&) {
+    counters[I].value.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename Runners, int... I>
+void bench_broadcast(bencher::Bencher<bencher::ExecutorState<5>>& bench, const std::string& name, std::integer_sequence<int, I...>)
+{
+    constexpr size_t event_count = 100'000;
+    bench.bench(name, std::to_string(sizeof...(I)), [&](auto& state) {
+        for (auto _ : state) {
+            auto event = event_runner::make_event<Event1>();
+            size_t expected[] = { counters[I].value + event_count... };
+            Runners runners;
+            for (size_t i = 0; i < event_count; ++i)
+                runners.notifyAll(event);
+            for (size_t consumer = 0; consumer < sizeof...(I); ++consumer) {
+                while (counters[consumer].value < expected[consumer])
+                    std::this_thread::yield();
+            }
+        }
+    });
+}
+
+// Former fan-out: every runner receives its own copy of the handle
+template<int... I>
+struct FanOutRunners {
+    std::tuple<event_runner::ThreadPool<countEvent<I>>...> runners { ((void)I, 1)... };
+    void notifyAll(const event_runner::SharedEvent& event) {
+        std::apply([&](auto&... runner) { (runner.schedule(event), ...); }, runners);
+    }
+};
+
+template<int... I>
+struct BroadcastRunners {
+    event_runner::BroadcastLog<> log;
+    std::tuple<event_runner::BroadcastRunner<countEvent<I>>...> runners { ((void)I, log)... };
+    void notifyAll(const event_runner::SharedEvent& event) {
+        log.publish(event);
+    }
+};
+
+template<int... I>
+void bench_broadcast(bencher::Bencher<bencher::ExecutorState<5>>& bench, std::integer_sequence<int, I...> sequence)
+{
+    bench_broadcast<FanOutRunners<I...>>(bench, "schedule on every runner", sequence);
+    bench_broadcast<BroadcastRunners<I...>>(bench, "broadcast log", sequence);
+}
+
+void bench_broadcast()
+{
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    bench_broadcast(bench, std::make_integer_sequence<int, 1>());
+    bench_broadcast(bench, std::make_integer_sequence<int, 4>());
+    bench_broadcast(bench, std::make_integer_sequence<int, 8>());
+    std::cout << "100000 events to every runner, by runner count\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-BATCH
+static std::atomic<size_t> drained { 0 };
+
+// Stands for a DB write or a log flush, paid once per handler call
+void simulated_flush()
+{
+    // The compiler barrier keeps the loop without a volatile counter
+    for (int i = 0; i < 100; ++i)
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+void flushPerEvent(const event_runner::IEvent&) {
+    simulated_flush();
+    drained.fetch_add(1, std::memory_order_relaxed);
+}
+
+void flushPerBatch(event_runner::EventSpan batch) {
+    simulated_flush();
+    drained.fetch_add(batch.size(), std::memory_order_relaxed);
+}
+
+template<auto F>
+void bench_batch(bencher::Bencher<bencher::ExecutorState<5>>& bench, const std::string& name, size_t batch_size)
+{
+    constexpr size_t event_count = 100'000;
+    event_runner::ThreadPool<F> runner(1, batch_size);
+    const event_runner::SharedEvent event = event_runner::make_event<Event1>();
+    bench.bench(name, std::to_string(batch_size), [&](auto& state) {
+        for (auto _ : state) {
+            size_t expected = drained + event_count;
+            for (size_t i = 0; i < event_count; ++i)
+                runner.schedule(event);
+            while (drained < expected)
+                std::this_thread::yield();
+        }
+    });
+}
+
+void bench_batch()
+{
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    for (size_t batch_size : { 1, 16, 256 }) {
+        bench_batch<flushPerEvent>(bench, "event handler", batch_size);
+        bench_batch<flushPerBatch>(bench, "span handler", batch_size);
+    }
+    std::cout << "100000 events on one runner, by batch size\n";
+    bencher::Formatter::display(bench.get_results());
+    for (const auto& result : bench.get_results()) {
+        std::cout << "  " << result.row << ", batch " << result.col << ": "
+                  << (result.result.duration ? 100'000'000 / result.result.duration : 0) << " events/s\n";
+    }
+}
+// END
+
+// BENCH-KEYED
+struct KeyedEvent : public event_runner::Event<KeyedEvent> {
+    KeyedEvent(uint64_t key, size_t sequence) : key(key), sequence(sequence) {}
+    const uint64_t key;
+    const size_t sequence;
+};
+
+constexpr size_t key_count = 64;
+static size_t last_sequence[key_count] = {};
+static std::atomic<size_t> out_of_order { 0 };
+static std::atomic<size_t> keyed_handled { 0 };
+static size_t keyed_sequence = 0;               // Increasing over every keyed runner
+
+// Each key belongs to one executor, its entry is never shared between threads
+void checkOrder(const event_runner::IEvent& event) {
+    const auto& keyed = static_cast<const KeyedEvent&>(event);
+    if (keyed.sequence <= last_sequence[keyed.key])
+        out_of_order.fetch_add(1, std::memory_order_relaxed);
+    last_sequence[keyed.key] = keyed.sequence;
+    simulated_flush();
+    keyed_handled.fetch_add(1, std::memory_order_relaxed);
+}
+
+void bench_keyed()
+{
+    constexpr size_t event_count = 64'000;
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    for (int threads : { 1, 2, 4 }) {
+        event_runner::ThreadPool<checkOrder> runner(threads, 16);
+        bench.bench("keyed", std::to_string(threads), [&](auto& state) {
+            for (auto _ : state) {
+                size_t expected = keyed_handled + event_count;
+                for (size_t i = 0; i < event_count; ++i) {
+                    runner.schedule(event_runner::make_event<KeyedEvent>(i % key_count, ++keyed_sequence), i % key_count);
+                }
+                while (keyed_handled < expected)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    std::cout << "64000 events over 64 keys, by executor count\n";
+    bencher::Formatter::display(bench.get_results());
+    std::cout << "Events out of order: " << out_of_order << "\n";
+}
+// END
+
+// BENCH-POOL
+static std::atomic<size_t> released { 0 };
+
+void countRelease(const event_runner::IEvent&) {
+    released.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Former event layout: a std::shared_ptr copied in the queue of a runner draining batches of 16
+struct SharedRunner {
+    std::mutex mutex;
+    std::condition_variable waiter;
+    std::deque<std::shared_ptr<event_runner::IEvent>> events;
+    bool running = true;
+    std::thread executor { &SharedRunner::execute_thread, this };
+
+    ~SharedRunner() {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            running = false;
+            waiter.notify_one();
+        }
+        executor.join();
+    }
+
+    void schedule(const std::shared_ptr<event_runner::IEvent>& event) {
+        std::lock_guard<std::mutex> lock { mutex };
+        events.push_back(event);
+        waiter.notify_one();
+    }
+
+    void execute_thread() {
+        std::vector<std::shared_ptr<event_runner::IEvent>> batch;
+        std::unique_lock<std::mutex> lock { mutex };
+        while (running || !events.empty()) {
+            waiter.wait(lock, [&]() { return !running || !events.empty(); });
+            while (!events.empty()) {
+                size_t count = std::min<size_t>(events.size(), 16);
+                std::move(events.begin(), events.begin() + count, std::back_inserter(batch));
+                events.erase(events.begin(), events.begin() + count);
+                lock.unlock();
+                for (const auto& event : batch)
+                    countRelease(*event);
+                batch.clear();
+                lock.lock();
+            }
+        }
+    }
+};
+
+// The events are created by the producer, sent to every runner and released by the last one
+template<typename Runner, typename Make>
+void bench_pool(bencher::Bencher<bencher::ExecutorState<5>>& bench, const std::string& name, size_t runner_count, Make&& make)
+{
+    constexpr size_t event_count = 100'000;
+    std::vector<std::unique_ptr<Runner>> runners;
+    for (size_t i = 0; i < runner_count; ++i) {
+        if constexpr (std::is_constructible<Runner, int, size_t>::value)
+            runners.push_back(std::make_unique<Runner>(1, 16));
+        else
+            runners.push_back(std::make_unique<Runner>());
+    }
+    bench.bench(name, std::to_string(runner_count), [&](auto& state) {
+        for (auto _ : state) {
+            size_t expected = released + event_count * runner_count;
+            for (size_t i = 0; i < event_count; ++i) {
+                auto event = make(i);
+                for (auto& runner : runners)
+                    runner->schedule(event);
+            }
+            while (released < expected)
+                std::this_thread::yield();
+        }
+    });
+}
+
+void bench_pool()
+{
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    event_runner::EventPool<KeyedEvent> pool;
+    for (size_t runner_count : { 1, 2, 4 }) {
+        bench_pool<SharedRunner>(bench, "make_shared", runner_count, [](size_t i) {
+            return std::shared_ptr<event_runner::IEvent>(std::make_shared<KeyedEvent>(i, i));
+        });
+        bench_pool<event_runner::ThreadPool<countRelease>>(bench, "make_event", runner_count, [](size_t i) {
+            return event_runner::SharedEvent(event_runner::make_event<KeyedEvent>(i, i));
+        });
+        bench_pool<event_runner::ThreadPool<countRelease>>(bench, "event pool", runner_count, [&](size_t i) {
+            return event_runner::SharedEvent(pool.make(i, i));
+        });
+    }
+    std::cout << "100000 events created, sent to every runner then released, by runner count\n";
+    bencher::Formatter::display(bench.get_results());
+    std::cout << "Pool allocations: " << pool.allocated() << "\n";
+}
+// END
+
+// BENCH-ASSIST
+// The producer runs a bounded batch itself every assist events, then helps until the runner is empty
+void bench_assist(bencher::Bencher<bencher::ExecutorState<5>>& bench, size_t assist)
+{
+    constexpr size_t event_count = 100'000;
+    event_runner::ThreadPool<flushPerEvent> runner(1, 16);
+    const event_runner::SharedEvent event = event_runner::make_event<Event1>();
+    bench.bench("flush per event", assist ? std::to_string(assist) : "runner only", [&](auto& state) {
+        for (auto _ : state) {
+            size_t expected = drained + event_count;
+            for (size_t i = 1; i <= event_count; ++i) {
+                runner.schedule(event);
+                if (assist && i % assist == 0)
+                    runner.execute(16);
+            }
+            while (drained < expected) {
+                if (!assist || runner.execute(16) == 0)
+                    std::this_thread::yield();
+            }
+        }
+    });
+}
+
+void bench_assist()
+{
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    for (size_t assist : { 0, 64, 16 })
+        bench_assist(bench, assist);
+    std::cout << "100000 events on one runner, by events scheduled between two assists\n";
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
+// BENCH-COALESCE
+struct ChangeEvent : public event_runner::Event<ChangeEvent> {
+    explicit ChangeEvent(size_t changes) : changes(changes) {}
+    const size_t changes;
+};
+
+static std::atomic<size_t> changes_seen { 0 };
+
+void applyChanges(const event_runner::IEvent& event) {
+    changes_seen.fetch_add(static_cast<const ChangeEvent&>(event).changes, std::memory_order_relaxed);
+    flushPerEvent(event);
+}
+
+// A merged event keeps the count of every change it absorbed
+event_runner::SharedEvent mergeChanges(const event_runner::SharedEvent& pending, const event_runner::SharedEvent& newer) {
+    return event_runner::make_event<ChangeEvent>(static_cast<const ChangeEvent&>(*pending).changes
+                                         + static_cast<const ChangeEvent&>(*newer).changes);
+}
+
+// A handler redrawing its entity, costly enough for the coalescing to pay for its map lookups
+void redrawPerEvent(const event_runner::IEvent&) {
+    for (int i = 0; i < 50; ++i)
+        simulated_flush();
+    drained.fetch_add(1, std::memory_order_relaxed);
+}
+
+enum class Coalescing { None, Replace, Merge };
+
+// Bursts of changes on 100 entities
+void bench_coalesce(bencher::Bencher<bencher::ExecutorState<5>>& bench, Coalescing coalescing, const std::string& name)
+{
+    constexpr size_t event_count = 100'000;
+    event_runner::ThreadPool<redrawPerEvent> runner(1, 16);
+    const event_runner::SharedEvent event = event_runner::make_event<ChangeEvent>(1);
+    size_t handled = 0;
+    bench.bench(name, "100 keys", [&](auto& state) {
+        for (auto _ : state) {
+            size_t start = drained;
+            size_t absorbed = runner.coalesced_count();
+            for (size_t i = 0; i < event_count; ++i) {
+                if (coalescing == Coalescing::Replace)
+                    runner.coalesce(event, i % 100);
+                else if (coalescing == Coalescing::Merge)
+                    runner.coalesce(event, i % 100, mergeChanges);
+                else
+                    runner.schedule(event, i % 100);
+            }
+            size_t expected = start + event_count - (runner.coalesced_count() - absorbed);
+            while (drained < expected)
+                std::this_thread::yield();
+            handled = expected - start;
+        }
+    });
+    std::cout << name << ": " << handled << " of 100000 events handled\n";
+}
+
+void bench_coalesce()
+{
+    bencher::Bencher<bencher::ExecutorState<5>> bench;
+    bench_coalesce(bench, Coalescing::None, "scheduled");
+    bench_coalesce(bench, Coalescing::Replace, "coalesced");
+    bench_coalesce(bench, Coalescing::Merge, "merged");
+    bencher::Formatter::display(bench.get_results());
+}
+// END
+
 // TESTS
 int main()
 {
     std::cout << "EventRunner\n";
     {
         Application app;
-        auto event1 = std::make_shared<Event1>();
-        auto event2 = std::make_shared<Event2>();
+        auto event1 = event_runner::make_event<Event1>();
+        auto event2 = event_runner::make_event<Event2>();
         app.notifyAll(event1);
         app.notifyAll(event2);
-        while (!event1->eventRan && event2->eventRan) ;
+        while (!event1->eventRan || !event2->eventRan) ;
+    }
+    {
+        // TEST-DISPATCH
+        DispatchedApplication app;
+        app.notifyAll(event_runner::make_event<Event1>());
+        app.notifyAll(event_runner::make_event<Event2>());
+        // An event without Event<E> base is untyped, it reaches no typed handler
+        app.notifyAll(event_runner::make_event<LegacyEvent>());
+        event_runner::Dispatcher().on<onEvent1>()(LegacyEvent());
+        event_runner::Dispatcher()(LegacyEvent());
+    }
+    {
+        // TEST-BROADCAST
+        BroadcastApplication app;
+        app.notifyAll(event_runner::make_event<Event1>());
+        app.notifyAll(event_runner::make_event<Event2>());
+        std::cout << "Slowest consumer " << app.log.slowest() << ", lag " << app.log.lag(app.log.slowest()) << "\n";
+        // Released cursors are reused, runners can come and go on a log of 8 consumers
+        std::vector<std::thread> subscribers;
+        for (int thread = 0; thread < 4; ++thread) {
+            subscribers.emplace_back([&]() {
+                for (int i = 0; i < 8; ++i)
+                    event_runner::BroadcastRunner<&dispatcher1> transient { app.log };
+            });
+        }
+        for (auto& subscriber : subscribers)
+            subscriber.join();
+        std::cout << "32 transient runners subscribed to a log of 8 consumers\n";
+        // A consumer subscribing while the producer runs laps ahead of every cursor reads the next events
+        event_runner::BroadcastLog<16> busy;
+        std::atomic<bool> publishing { true };
+        std::thread producer([&]() { while (publishing) busy.publish(event_runner::make_event<Event1>()); });
+        size_t late = busy.subscribe();
+        int read = 0;
+        for (auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1); read < 100 && std::chrono::steady_clock::now() < deadline;) {
+            if (busy.peek(late) == nullptr) {
+                std::this_thread::yield();
+                continue;
+            }
+            busy.advance(late);
+            ++read;
+        }
+        busy.unsubscribe(late);
+        publishing = false;
+        producer.join();
+        std::cout << "Late subscriber read " << read << " of 100 events\n";
+        // Subscribers join and leave while producers publish, with zero or more consumers: none is lapped
+        event_runner::BroadcastLog<4> churn;
+        publishing = true;
+        std::vector<std::thread> producers;
+        for (int thread = 0; thread < 3; ++thread)
+            producers.emplace_back([&]() { while (publishing) churn.publish(event_runner::make_event<Event1>()); });
+        std::atomic<size_t> stalled { 0 };
+        std::vector<std::thread> churners;
+        for (int thread = 0; thread < 3; ++thread) {
+            churners.emplace_back([&]() {
+                for (int subscription = 0; subscription < 2000; ++subscription) {
+                    size_t consumer = churn.subscribe();
+                    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+                    for (int read = 0; read < 20;) {
+                        if (churn.peek(consumer) != nullptr) {
+                            churn.advance(consumer);
+                            ++read;
+                        } else if (std::chrono::steady_clock::now() < deadline) {
+                            std::this_thread::yield();
+                        } else {
+                            ++stalled;
+                            break;
+                        }
+                    }
+                    churn.unsubscribe(consumer);
+                }
+            });
+        }
+        for (auto& churner : churners)
+            churner.join();
+        publishing = false;
+        for (auto& producer : producers)
+            producer.join();
+        std::cout << "6000 subscriptions during publication, " << stalled << " stalled\n";
+    }
+    {
+        // TEST-KEYED
+        event_runner::ThreadPool<checkOrder> runner(4);
+        for (uint64_t key = 0; key < 1000; ++key)
+            runner.schedule(event_runner::make_event<KeyedEvent>(key % 7, ++keyed_sequence), key % 7);
+    }
+    std::cout << "Keyed events out of order: " << out_of_order << "\n";
+    {
+        // TEST-THROW
+        event_runner::ThreadPool<failOnce> runner(1);
+        runner.schedule(event_runner::make_event<FailingEvent>(), 1);
+        for (size_t i = 0; i < 10; ++i)
+            runner.schedule(event_runner::make_event<Event1>(), 1);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (survived < 10 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+        std::cout << "Keyed events handled after a throwing handler: " << survived << " of 10\n";
+    }
+    {
+        // TEST-COALESCE
+        event_runner::ThreadPool<applyChanges> runner(2);
+        for (size_t i = 0; i < 1000; ++i)
+            runner.coalesce(event_runner::make_event<ChangeEvent>(1), i % 10, mergeChanges);
+        while (changes_seen < 1000)
+            std::this_thread::yield();
+        // A drained key is forgotten, the next change is queued again
+        runner.coalesce(event_runner::make_event<ChangeEvent>(1), 3, mergeChanges);
+        while (changes_seen < 1001)
+            std::this_thread::yield();
+        std::cout << "Key changed again after draining, " << runner.pending_keys() << " pending keys\n";
+    }
+    std::cout << "Coalesced changes seen: " << changes_seen << " of 1001\n";
+    {
+        // TEST-POOL
+        // Any thread makes pooled events, and they outlive their pool
+        std::vector<event_runner::SharedEvent> survivors;
+        {
+            event_runner::EventPool<KeyedEvent> pool;
+            survivors.push_back(pool.make(0, 0));
+            std::thread([&]() { survivors.push_back(pool.make(1, 1)); }).join();
+            survivors.pop_back();
+            survivors.push_back(pool.make(2, 2));
+            std::cout << "Pool allocations for 3 events, one made by another thread: " << pool.allocated() << "\n";
+        }
+        std::thread([&]() { survivors.clear(); }).join();
+        std::cout << "Pooled events released after their pool\n";
+    }
+    {
+        // TEST-LATENCY
+        event_runner::ThreadPool<countRelease> fast(1);
+        event_runner::ThreadPool<flushPerEvent> slow(1);
+        size_t fast_expected = released + 10'000;
+        size_t slow_expected = drained + 10'000;
+        for (size_t i = 0; i < 10'000; ++i) {
+            const event_runner::SharedEvent event = event_runner::make_event<Event1>();
+            fast.schedule(event);
+            slow.schedule(event);
+        }
+        while (released < fast_expected || drained < slow_expected)
+            std::this_thread::yield();
+        if (slow.latency().handled == 0) {
+            std::cout << "Latency compiled out, build with -DEVENT_RUNNER_METRICS=1\n";
+        } else {
+            std::cout << "Fast runner: " << fast.latency() << "\n"
+                      << "Slow runner: " << slow.latency() << "\n";
+        }
+        // END
     }
     std::cout << "End ThreadPool\n";
+    bench_dispatch();
+    bench_broadcast();
+    bench_batch();
+    bench_keyed();
+    bench_pool();
+    bench_assist();
+    bench_coalesce();
     return 0;
 }
@@ -1,8 +1,10 @@
 #include "rcu_atomic.h"
+#include "rcu_epoch.h"
 #include "rcu_shared.h"
 #include "rcu_simple.h"
 #include "rcu_spin.h"
 
+#include <condition_variable>
 #include <iostream>
 #include <string>
 
@@ -24,8 +26,13 @@ template<typename RCU>
 struct Testing {
     static RCU rcu_bench;
     static void reader() {
-        auto snapshot = rcu_bench.get_shared();
-        volatile int a = snapshot->a;
+        if constexpr (requires { rcu_bench.get(); }) {
+            auto guard = rcu_bench.get();
+            volatile int a = guard->a;
+        } else {
+            auto snapshot = rcu_bench.get_shared();
+            volatile int a = snapshot->a;
+        }
     }
 
     static void writer() {
@@ -40,10 +47,12 @@ using Simple = Testing<rcu_simple::RCU<Parent>>;
 using Shared = Testing<rcu_shared::RCU<Parent>>;
 using Atomic = Testing<rcu_atomic::RCU<Parent>>;
 using Spin = Testing<rcu_spin::RCU<Parent>>;
+using Epoch = Testing<rcu_epoch::RCU<Parent>>;
 template<> decltype(Simple::rcu_bench) Simple::rcu_bench { std::make_shared<Parent>() };
 template<> decltype(Shared::rcu_bench) Shared::rcu_bench { std::make_shared<Parent>() };
 template<> decltype(Atomic::rcu_bench) Atomic::rcu_bench { std::make_shared<Parent>() };
 template<> decltype(Spin::rcu_bench) Spin::rcu_bench { std::make_shared<Parent>() };
+template<> decltype(Epoch::rcu_bench) Epoch::rcu_bench { std::make_shared<Parent>() };
 
 // BENCH
 using Bench = bencher::Bencher<bencher::ExecutorState<100'000>>;
@@ -107,6 +116,10 @@ int main() {
     multi_executor(results, "Spin Re7 - Wr1", { Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::writer });
     multi_executor(results, "Spin Re4 - Wr4", { Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::writer, Spin::writer, Spin::writer, Spin::writer });
     multi_executor(results, "Spin Re1 - Wr7", { Spin::reader, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer });
+
+    multi_executor(results, "Epoch Re7 - Wr1", { Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::writer });
+    multi_executor(results, "Epoch Re4 - Wr4", { Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer });
+    multi_executor(results, "Epoch Re1 - Wr7", { Epoch::reader, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer });
     
     starvation = true;
 
@@ -126,6 +139,10 @@ int main() {
     multi_executor(results, "Spin Starved Re4 - Wr4", { Spin::reader, Spin::reader, Spin::reader, Spin::reader, Spin::writer, Spin::writer, Spin::writer, Spin::writer });
     multi_executor(results, "Spin Starved Re1 - Wr7", { Spin::reader, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer, Spin::writer });
 
+    multi_executor(results, "Epoch Starved Re7 - Wr1", { Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::writer });
+    multi_executor(results, "Epoch Starved Re4 - Wr4", { Epoch::reader, Epoch::reader, Epoch::reader, Epoch::reader, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer });
+    multi_executor(results, "Epoch Starved Re1 - Wr7", { Epoch::reader, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer, Epoch::writer });
+
     bencher::Formatter::Options display_options;
     display_options.sort_cols = true;
     bencher::Formatter::display(results, display_options);
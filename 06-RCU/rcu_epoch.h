@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace rcu_epoch {
+    // Epoch-based reclamation: a reader publishes the epoch it entered in, a writer frees a retired
+    // version once every reader has left the epochs where that version was still reachable.
+    struct Domain {
+        static constexpr uint64_t idle = UINT64_MAX;
+        static constexpr size_t max_readers = 256;
+
+        struct alignas(64) Reader {
+            std::atomic<uint64_t> epoch { idle };
+            std::atomic<bool> used { false };
+            size_t depth = 0;                   // Nested guards, owner thread only
+        };
+
+        static Domain& instance() {
+            static Domain domain;
+            return domain;
+        }
+
+        Reader& acquire() {
+            for (auto& reader : readers) {
+                bool unused = false;
+                if (reader.used.compare_exchange_strong(unused, true)) {
+                    size_t index = &reader - readers.data();
+                    size_t count = reader_count.load();
+                    while (count <= index && !reader_count.compare_exchange_weak(count, index + 1))
+                        ;
+                    return reader;
+                }
+            }
+            throw std::length_error("rcu_epoch: too many reader threads");
+        }
+
+        // Oldest epoch a reader is still in, idle when no reader is active
+        uint64_t oldest() const {
+            uint64_t minimum = idle;
+            size_t count = reader_count.load();
+            for (size_t index = 0; index < count; ++index)
+                minimum = std::min(minimum, readers[index].epoch.load());
+            return minimum;
+        }
+
+        std::atomic<uint64_t> epoch { 0 };
+        std::atomic<size_t> reader_count { 0 };
+        std::array<Reader, max_readers> readers;
+    };
+
+    // Slot of the calling thread, given back when the thread exits
+    inline Domain::Reader& this_reader() {
+        struct Local {
+            Domain::Reader* reader = nullptr;
+            ~Local() { if (reader) reader->used = false; }
+        };
+        thread_local Local local;
+        if (!local.reader)
+            local.reader = &Domain::instance().acquire();
+        return *local.reader;
+    }
+
+    // A read costs one store in the thread slot, the shared data is never written by readers
+    template<typename T>
+    class ReadGuard {
+    public:
+        ReadGuard(const std::atomic<const T*>& data) : reader(this_reader()) {
+            if (reader.depth++ == 0)
+                reader.epoch.store(Domain::instance().epoch.load());
+            ptr = data.load();
+        }
+        ~ReadGuard() {
+            if (--reader.depth == 0)
+                reader.epoch.store(Domain::idle, std::memory_order_release);
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const T* get() const noexcept { return ptr; }
+        const T* operator->() const noexcept { return ptr; }
+        const T& operator*() const noexcept { return *ptr; }
+        explicit operator bool() const noexcept { return ptr != nullptr; }
+    private:
+        Domain::Reader& reader;
+        const T* ptr;
+    };
+
+    template<typename T>
+    class RCU {
+    public:
+        // Construct
+        RCU() = default;
+        RCU(T* ptr) : RCU(std::shared_ptr<const T>(ptr)) {}
+        // Copy
+
+        RCU(const RCU& other) : RCU(other.get_shared()) {}
+        RCU& operator=(const RCU& other) { return *this = other.get_shared(); }
+        RCU& operator=(const std::shared_ptr<const T>& other) {
+            std::scoped_lock update_lock { update_mtx };
+            replace(other);
+            return *this;
+        }
+        // Move
+        RCU(RCU&& other) : RCU(std::move(other.shared_data)) { other.current = nullptr; }
+        RCU(std::shared_ptr<const T>&& other) : shared_data(std::move(other)), current(shared_data.get()) { }
+        RCU& operator=(RCU&& other) {
+            if (this != &other) {
+                *this = std::move(other.shared_data);
+                other.current = nullptr;
+            }
+            return *this;
+        }
+        RCU& operator=(std::shared_ptr<const T>&& other) {
+            std::scoped_lock update_lock { update_mtx };
+            replace(std::move(other));
+            return *this;
+        }
+        // Access
+        ReadGuard<T> get() const {
+            return ReadGuard<T>(current);
+        }
+        // Slow path, the owning pointer is only read under the writer mutex
+        std::shared_ptr<const T> get_shared() const {
+            std::scoped_lock update_lock { update_mtx };
+            return shared_data;
+        }
+        explicit operator std::shared_ptr<const T>() const { return get_shared(); }
+        explicit operator bool() const noexcept { return current.load() != nullptr; }
+        // Update
+        template<typename Updater>
+        void update(Updater updater) {
+            std::scoped_lock write_lock { update_mtx };
+            if (!shared_data)
+                return;
+            auto new_data = updater(*shared_data);
+            replace(std::move(new_data));
+        }
+        template<typename Updater>
+        void inline_update(Updater updater) {
+            std::scoped_lock write_lock { update_mtx };
+            if (!shared_data)
+                return;
+            updater(const_cast<T&>(*shared_data));
+        }
+    private:
+        // Called with the writer mutex: publish, then retire the previous version in the epoch it was replaced
+        void replace(std::shared_ptr<const T> data) {
+            current.store(data.get());
+            std::swap(shared_data, data);
+            Domain& domain = Domain::instance();
+            if (data)
+                retired.emplace_back(domain.epoch.fetch_add(1), std::move(data));
+            uint64_t oldest = domain.oldest();
+            while (!retired.empty() && retired.front().first < oldest)
+                retired.pop_front();
+        }
+
+        mutable std::mutex update_mtx;
+        std::shared_ptr<const T> shared_data;
+        std::atomic<const T*> current { nullptr };
+        std::deque<std::pair<uint64_t, std::shared_ptr<const T>>> retired;
+    };
+}